@@ -23,26 +23,21 @@
 
 #include <arduino.h>
 #include "commands.h"
-
-#define UART_SPEED 9600
-/*
-波特率配置源码：
-uint16_t baud_setting = (F_CPU / 4 / baud - 1) / 2;   //此处实际+0.5做近似处理，没有错误
-可设置的波特率： Fcpu/8/(n+1)   n>=0  测试最大1M可用
-
- */
+#include "link.h"
+#include "defines.h"
+#include "spi_cmd.h"
 
 int CMD;
 
 void setup() {
-  Serial.begin(UART_SPEED);       //串口配置（arduino的USB虚拟串口存在一些问题，需要先用arduino打开一次串口）
-  Serial.setTimeout(1000);        //等待数据流的最大时间间隔 ms 若稳定性差试试提高这个间隔
+  link_begin(UART_SPEED);         //串口配置（arduino的USB虚拟串口存在一些问题，需要先用arduino打开一次串口）
 }
 
 void loop() {
   
-  if (Serial.available() > 0) {
-    CMD = Serial.read();            //从设备接收到数据中读取一个字节的数据。
+  CMD = cmd_receive();              //非阻塞地接收命令码和参数头，未收齐时返回-1
+  if (CMD >= 0)
     ParseCommand(CMD);              //解析命令
-  }
+
+  spi_job_poll();                   //命令之间（包括接收参数期间）推进后台任务（后台擦除）
 }
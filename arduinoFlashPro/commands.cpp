@@ -21,14 +21,141 @@
 
 #include <arduino.h>
 #include "commands.h"
+#include "link.h"
 #include "spi_cmd.h"
 #include "i2c_cmd.h"
 #include "gpio_cmd.h"
+#include "uart_cmd.h"
 #include "defines.h"
 
 byte buff[buffSize];
 
+//等待应答发送完成，流水线模式下不等待，以便尽快处理下一条命令
+void cmd_flush() {
+  if (!pipe_mode)
+    link_flush();
+}
+
+//命令参数头的总长度（含流水线模式的标签），p为已收到的n字节，长度取决于已收到的内容时随n增加而确定
+//只包括处理函数开始时读取的参数，之后的数据段（如编程数据、写入数据）仍由处理函数读取
+//地址长度等参数不合法时只计到处理函数检查并回传ERROR_RECV的位置，与处理函数读取的字节数一致
+static byte cmd_hdr_len(char cmd, const byte *p, byte n)
+{
+  byte t = pipe_mode ? 1 : 0;
+
+  if (n < t)
+    return t;
+  p += t;
+  n -= t;
+
+  switch(cmd)
+  {
+    case FUNC_SPI_INIT:
+    case FUNC_SPI_READ:
+    case FUNC_SPI_WRITE:
+    case FUNC_SPI_CS_SEL:
+    case FUNC_I2C_INIT:
+    case FUNC_I2C_WRITE:
+    case FUNC_GPIO_WRITE:
+    case FUNC_UART_FRAME:
+    case FUNC_UART_PIPE:
+      return t + 1;
+    case FUNC_SPI_BUS:
+    case FUNC_I2C_READ:
+    case FUNC_GPIO_INIT:
+      return t + 2;
+    case FUNC_SPI_XFER:
+    case FUNC_I2C_XFER:
+      return t + 3;
+    case FUNC_SPI_WRITE_STREAM:
+    case FUNC_UART_BAUD:
+      return t + 4;
+    case FUNC_I2C_READ_STREAM:
+      return t + 10;
+    case FUNC_I2C_EE_WRITE:
+      return t + 11;
+
+    case FUNC_SPI_READ_BULK:      //操作码 地址长度 空字节数 地址(3/4) 长度(4)
+    case FUNC_SPI_CRC32:
+    case FUNC_SPI_BLANK:
+    case FUNC_SPI_SECTOR_CRC:
+      if (n < 3 || (p[1] != 3 && p[1] != 4) || (p[2] & 0x0f) > 4)
+        return t + 3;
+      return t + 3 + p[1] + 4;
+    case FUNC_SPI_PROGRAM:        //操作码 地址长度 地址(3/4) 长度(4)
+      if (n < 2 || (p[1] != 3 && p[1] != 4))
+        return t + 2;
+      return t + 2 + p[1] + 4;
+    case FUNC_SPI_ERASE:          //类型 地址长度 地址(3/4) 长度(4)
+      if (n < 2 || (p[0] & 0x7f) > 4 || (p[1] != 3 && p[1] != 4))
+        return t + 2;
+      return t + 2 + p[1] + 4;
+
+    default:
+      return t;
+  }
+}
+
+static int rx_cmd = -1;           //正在接收参数头的命令码，-1表示空闲
+static byte rx_hdr[LINK_UNREAD_SIZE];
+static byte rx_n;
+static unsigned long rx_last;     //收到上一字节的时间
+
+//非阻塞地接收命令码及其参数头，由loop()反复调用，参数未收齐时立即返回-1，主循环可继续推进后台任务
+//收齐后把参数头放回链路层（link_unread），返回命令码，处理函数照常用link_read读取参数
+//参数之间超过LINK_TIMEOUT时与处理函数中link_read超时相同，回传ERROR_TIMOUT（流水线模式下未收到标签时不回传）
+int cmd_receive()
+{
+  int c;
+  byte need;
+
+  if (rx_cmd < 0) {
+    c = link_read_byte();
+    if (c < 0)
+      return -1;
+    rx_cmd = c;
+    rx_n = 0;
+    rx_last = millis();
+  }
+
+  while ((need = cmd_hdr_len(rx_cmd, rx_hdr, rx_n)) > rx_n)
+  {
+    c = link_read_byte();
+    if (c < 0) {
+      if (millis() - rx_last < LINK_TIMEOUT)
+        return -1;                //参数未收齐，先回到主循环
+
+      rx_cmd = -1;
+      if (pipe_mode) {
+        if (rx_n == 0)
+          return -1;
+        link_write(rx_hdr[0]);    //应答前先回传标签
+      }
+      link_write(ERROR_TIMOUT);
+      cmd_flush();
+      return -1;
+    }
+    rx_hdr[rx_n++] = c;
+    rx_last = millis();
+  }
+
+  link_unread(rx_hdr, rx_n);
+  c = rx_cmd;
+  rx_cmd = -1;
+  return c;
+}
+
 void ParseCommand(char cmd) {
+  byte tag;
+
+  if (pipe_mode) {
+    if (link_read(&tag, 1) != 1)     //流水线模式下命令码后跟1字节标签
+      return;
+    link_write(tag);            //应答前先回传标签
+  }
+
+  spi_job_sync(cmd);            //访问正在后台擦除的芯片时先等待擦除完成
+
   //spi 读、写、初始化、解除初始化
   switch(cmd)
   {
@@ -54,6 +181,39 @@ void ParseCommand(char cmd) {
     case FUNC_SPI_TST:
       spi_cmd_tst();
       break;
+    case FUNC_SPI_READ_BULK:
+      spi_cmd_read_bulk();
+      break;
+    case FUNC_SPI_PROGRAM:
+      spi_cmd_program();
+      break;
+    case FUNC_SPI_ERASE:
+      spi_cmd_erase();
+      break;
+    case FUNC_SPI_CRC32:
+      spi_cmd_crc32();
+      break;
+    case FUNC_SPI_BLANK:
+      spi_cmd_blank();
+      break;
+    case FUNC_SPI_SECTOR_CRC:
+      spi_cmd_sector_crc();
+      break;
+    case FUNC_SPI_XFER:
+      spi_cmd_xfer();
+      break;
+    case FUNC_SPI_WRITE_STREAM:
+      spi_cmd_write_stream();
+      break;
+    case FUNC_SPI_CS_SEL:
+      spi_cmd_cs_sel();
+      break;
+    case FUNC_SPI_BUS:
+      spi_cmd_bus();
+      break;
+    case FUNC_SPI_JOB:
+      spi_cmd_job();
+      break;
 
     //i2c
     case FUNC_I2C_INIT:
@@ -74,6 +234,15 @@ void ParseCommand(char cmd) {
     case FUNC_I2C_STOP:
       i2c_cmd_stop();
       break;
+    case FUNC_I2C_EE_WRITE:
+      i2c_cmd_ee_write();
+      break;
+    case FUNC_I2C_XFER:
+      i2c_cmd_xfer();
+      break;
+    case FUNC_I2C_READ_STREAM:
+      i2c_cmd_read_stream();
+      break;
     case FUNC_I2C_TST:
       i2c_cmd_tst();
       break;
@@ -92,8 +261,19 @@ void ParseCommand(char cmd) {
       gpio_write();
       break;
 
+    //uart
+    case FUNC_UART_BAUD:
+      uart_cmd_baud();
+      break;
+    case FUNC_UART_FRAME:
+      uart_cmd_frame();
+      break;
+    case FUNC_UART_PIPE:
+      uart_cmd_pipe();
+      break;
+
     default:
-      Serial.write(ERROR_NO_CMD);     //错误的cmd 100
-      Serial.flush();
+      link_write(ERROR_NO_CMD);     //错误的cmd 100
+      cmd_flush();
   }
 }
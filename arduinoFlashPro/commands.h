@@ -10,6 +10,19 @@
 #define FUNC_SPI_READ 11
 #define FUNC_SPI_WRITE 12
 #define FUNC_SPI_TST 13
+#define FUNC_SPI_READ_BULK 14
+#define FUNC_SPI_PROGRAM 15
+#define FUNC_SPI_ERASE 16
+#define FUNC_SPI_CRC32 17
+#define FUNC_SPI_BLANK 18
+#define FUNC_SPI_SECTOR_CRC 19
+
+//上位机传送的SPI扩展命令码
+#define FUNC_SPI_XFER 50
+#define FUNC_SPI_WRITE_STREAM 51
+#define FUNC_SPI_CS_SEL 52
+#define FUNC_SPI_BUS 53
+#define FUNC_SPI_JOB 54
 
 //上位机传送的I2C命令码
 #define FUNC_I2C_INIT      20
@@ -18,7 +31,10 @@
 #define FUNC_I2C_WRITE     23
 #define FUNC_I2C_START     24
 #define FUNC_I2C_STOP      25
+#define FUNC_I2C_EE_WRITE  26
+#define FUNC_I2C_XFER      27
 #define FUNC_I2C_TST       28
+#define FUNC_I2C_READ_STREAM 29
 
 
 //上位机传送的GPIO码（支持8路GPIO）
@@ -28,6 +44,14 @@
 #define FUNC_GPIO_WRITE   33
 
 
+//上位机传送的串口命令码
+#define FUNC_UART_BAUD    40
+#define FUNC_UART_FRAME   41
+#define FUNC_UART_PIPE    42
+
+
+#define STATUS_NAK 95           //帧模式下收到错误帧，其后跟期望的帧序号
+#define STATUS_BUSY 96          //长时间操作进行中，周期性回传的进度字节
 #define ERROR_OPERAT 97
 #define ERROR_TIMOUT 98
 #define ERROR_RECV 99
@@ -35,7 +59,9 @@
 
 
 
+int cmd_receive();
 void ParseCommand(char cmd);
+void cmd_flush();
 
 
 #endif
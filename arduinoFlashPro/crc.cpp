@@ -0,0 +1,54 @@
+/*
+	该程序基于简易的arduino硬件，主要目的是烧录SPI Flash，如W25QXX等，主要原理是实现了UART转SPI的功能，需配合上位机使用。
+  也可烧录eepron，如24cxx
+  校验计算
+    Copyright (C) 2023  LiHangBing
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <arduino.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include "crc.h"
+
+//CRC32（多项式0xEDB88320，反射）半字节查找表，放在Flash中仅占64字节
+static const uint32_t crc32_tab[16] PROGMEM = {
+  0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+  0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+  0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+  0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+//计算CRC32，可分段调用：crc首次传入CRC32_INIT，全部数据处理完后取反
+uint32_t crc32_update(uint32_t crc, const byte *data, uint16_t len)
+{
+  while (len--)
+  {
+    crc ^= *data++;
+    crc = (crc >> 4) ^ pgm_read_dword(&crc32_tab[crc & 0x0f]);     //每字节查表两次
+    crc = (crc >> 4) ^ pgm_read_dword(&crc32_tab[crc & 0x0f]);
+  }
+  return crc;
+}
+
+//计算CRC16-CCITT（多项式0x1021，初值0，即XMODEM），用于帧校验
+uint16_t crc16_update(uint16_t crc, const byte *data, uint16_t len)
+{
+  while (len--)
+    crc = _crc_xmodem_update(crc, *data++);
+  return crc;
+}
@@ -0,0 +1,12 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include <arduino.h>
+
+#define CRC32_INIT 0xffffffffUL     //CRC32初值，结果需再取反（与zlib的crc32一致）
+
+uint32_t crc32_update(uint32_t crc, const byte *data, uint16_t len);
+uint16_t crc16_update(uint16_t crc, const byte *data, uint16_t len);    //CRC16-CCITT(XMODEM)，初值0
+
+
+#endif
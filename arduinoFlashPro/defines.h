@@ -1,19 +1,59 @@
 #ifndef DEFINES_H
 #define DEFINES_H
 
-#define buffSize 64         //缓冲区长度（不能超过串口缓冲区大小 64）
+#define buffSize 128        //缓冲区长度，即单次SPI/I2C传输的最大长度（不能超过255、LINK_RX_SIZE）
 
-#define ISP_RST   10        //复位引脚可随意，下面为硬件决定
+//USART收发环形缓冲区大小（ATmega32U4使用USB CDC，不使用），必须为2的幂且不超过256，
+//RAM紧张时可减小（ATmega328P共2K RAM）
+#define LINK_RX_SIZE 256
+#define LINK_TX_SIZE 128
+
+#define UART_SPEED 9600     //上电默认波特率，之后可由上位机协商（FUNC_UART_BAUD）
+/*
+波特率配置源码：
+uint16_t baud_setting = (F_CPU / 4 / baud - 1) / 2;   //此处实际+0.5做近似处理，没有错误
+可设置的波特率： Fcpu/8/(n+1)   n>=0  测试最大1M可用
+ */
+
+#define ISP_RST   10        //复位引脚可随意（需在fast_pin.h中列出），下面为硬件决定
+#define ISP_CS1   9         //多片选时的其他CS引脚（选择掩码bit1~bit3），用于同时烧录多片相同的芯片
+#define ISP_CS2   8
+#define ISP_CS3   A0
+#define SPI_CS_COUNT  4
+#if defined(__AVR_ATmega32U4__)
+//Arduino Leonardo          16 14 15
 #define ISP_MOSI  16
 #define ISP_MISO  14
 #define ISP_SCK   15
+#else
 //Arduino Pro or Pro Mini   11 12 13
-//Arduino Leonardo          16 14 15
+#define ISP_MOSI  11
+#define ISP_MISO  12
+#define ISP_SCK   13
+#endif
 
+#define SPI_PAGE_SIZE     256     //SPI Flash页大小（W25QXX等均为256字节）
+#define SPI_SECTOR_SIZE   4096    //SPI Flash扇区大小（最小擦除单元）
+#define SPI_PP_TIMEOUT    20      //页编程最长等待时间 ms（W25Q典型0.7ms，最大3ms）
+#define SPI_SE_TIMEOUT    1000    //4K扇区擦除最长等待时间 ms（W25Q最大400ms）
+#define SPI_BE_TIMEOUT    4000    //32K/64K块擦除最长等待时间 ms（W25Q最大1.6s/2s）
+#define SPI_CE_TIMEOUT    400000UL  //整片擦除最长等待时间 ms（W25Q128最大200s，W25Q256最大400s）
+#define SPI_PROGRESS_MS   250     //擦除时回传进度字节的间隔 ms
+#define SPI_JOB_POLL_MS   10      //长命令执行期间轮询后台擦除的间隔 ms（每次需中断连续读并重新发送读命令头）
 
+
+#if defined(__AVR_ATmega32U4__)
+//Arduino Leonardo          3 2
+#define I2C_SCL   3
+#define I2C_SDA   2
+#else
+//Arduino Pro or Pro Mini   A5 A4   pullup is needed
 #define I2C_SCL   A5
 #define I2C_SDA   A4
-//Arduino Pro or Pro Mini   A5 A4   pullup is needed
+#endif
+
+#define I2C_EE_TIMEOUT    20      //EEPROM写周期最长等待时间 ms（24Cxx典型5ms，部分型号10ms）
+#define I2C_ASYNC_TIMEOUT 500     //中断驱动的I2C请求最长时间 ms（10K时一页130字节约130ms，加上写周期）
 
 
 #endif
@@ -0,0 +1,75 @@
+#ifndef FAST_PIN_H
+#define FAST_PIN_H
+
+#include <arduino.h>
+#include "defines.h"
+
+/*
+编译期引脚：FastPin<引脚号> 在编译时确定PORT寄存器和位，
+high()/low() 编译为单条 sbi/cbi 指令，代替digitalWrite运行时查表（约数微秒）
+release() 恢复为高阻输入：先改为输入再清PORT位，关闭上拉且不会短暂输出低电平
+未在下表中列出的引脚会在编译时报错
+*/
+template<uint8_t pin> struct FastPin;
+
+#define FAST_PIN(pin, port, bit) \
+  template<> struct FastPin<pin> { \
+    static inline void high() { PORT##port |= _BV(bit); } \
+    static inline void low() { PORT##port &= ~_BV(bit); } \
+    static inline void set(bool v) { if (v) high(); else low(); } \
+    static inline bool read() { return PIN##port & _BV(bit); } \
+    static inline void output() { DDR##port |= _BV(bit); } \
+    static inline void input() { DDR##port &= ~_BV(bit); } \
+    static inline void release() { input(); low(); } \
+  };
+
+#if defined(__AVR_ATmega32U4__)
+//Arduino Leonardo / Pro Micro
+FAST_PIN(0, D, 2)
+FAST_PIN(1, D, 3)
+FAST_PIN(2, D, 1)
+FAST_PIN(3, D, 0)
+FAST_PIN(4, D, 4)
+FAST_PIN(5, C, 6)
+FAST_PIN(6, D, 7)
+FAST_PIN(7, E, 6)
+FAST_PIN(8, B, 4)
+FAST_PIN(9, B, 5)
+FAST_PIN(10, B, 6)
+FAST_PIN(11, B, 7)
+FAST_PIN(12, D, 6)
+FAST_PIN(13, C, 7)
+FAST_PIN(18, F, 7)    //A0
+FAST_PIN(19, F, 6)    //A1
+FAST_PIN(20, F, 5)    //A2
+FAST_PIN(21, F, 4)    //A3
+#else
+//Arduino Pro / Pro Mini / Uno (ATmega328P/168)
+FAST_PIN(0, D, 0)
+FAST_PIN(1, D, 1)
+FAST_PIN(2, D, 2)
+FAST_PIN(3, D, 3)
+FAST_PIN(4, D, 4)
+FAST_PIN(5, D, 5)
+FAST_PIN(6, D, 6)
+FAST_PIN(7, D, 7)
+FAST_PIN(8, B, 0)
+FAST_PIN(9, B, 1)
+FAST_PIN(10, B, 2)
+FAST_PIN(11, B, 3)
+FAST_PIN(12, B, 4)
+FAST_PIN(13, B, 5)
+FAST_PIN(14, C, 0)    //A0
+FAST_PIN(15, C, 1)    //A1
+FAST_PIN(16, C, 2)    //A2
+FAST_PIN(17, C, 3)    //A3
+#endif
+
+//SPI片选引脚（多片选，对应选择掩码的bit0~bit3）
+typedef FastPin<ISP_RST> CsPin0;
+typedef FastPin<ISP_CS1> CsPin1;
+typedef FastPin<ISP_CS2> CsPin2;
+typedef FastPin<ISP_CS3> CsPin3;
+
+
+#endif
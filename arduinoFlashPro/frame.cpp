@@ -0,0 +1,96 @@
+/*
+	该程序基于简易的arduino硬件，主要目的是烧录SPI Flash，如W25QXX等，主要原理是实现了UART转SPI的功能，需配合上位机使用。
+  也可烧录eepron，如24cxx
+  带序号和CRC16的数据帧，用于高波特率下的选择性重传
+    Copyright (C) 2023  LiHangBing
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <arduino.h>
+#include "frame.h"
+#include "crc.h"
+#include "commands.h"
+#include "link.h"
+
+byte frame_mode = 0;
+
+//丢弃接收缓冲区中剩余的错误数据，直到线路空闲5ms
+static void drain_input()
+{
+  unsigned long last = millis();
+
+  while (millis() - last < 5)
+  {
+    if (link_available() > 0) {
+      link_read_byte();
+      last = millis();
+    }
+  }
+}
+
+//发送一帧
+void frame_send(byte seq, const byte *data, uint16_t len)
+{
+  byte hdr[2];
+  uint16_t crc;
+
+  hdr[0] = seq;
+  hdr[1] = (byte)len;         //256时为0
+  crc = crc16_update(0, hdr, 2);
+  crc = crc16_update(crc, data, len);
+
+  link_write(hdr, 2);
+  link_write(data, len);
+  link_write((byte)(crc >> 8));
+  link_write((byte)crc);
+}
+
+//接收序号为seq、长度为len的一帧，出错时回传NAK请求重发
+//收到上一帧的重发（上位机未收到ack）时重新回传ack
+//返回0成功，非0超过重传次数
+byte frame_recv(byte seq, byte *data, uint16_t len, byte ack)
+{
+  byte hdr[2];
+  byte tail[2];
+  uint16_t crc;
+  byte retry;
+
+  for (retry = 0; retry < FRAME_RETRY; retry++)
+  {
+    if (link_read(hdr, 2) == 2 && (hdr[1] ? hdr[1] : 256) == len &&
+        link_read(data, len) == len && link_read(tail, 2) == 2)
+    {
+      crc = crc16_update(0, hdr, 2);
+      crc = crc16_update(crc, data, len);
+      if (crc == (((uint16_t)tail[0] << 8) | tail[1])) {
+        if (hdr[0] == seq)
+          return 0;
+        if (hdr[0] == (byte)(seq - 1)) {
+          link_write(ack);      //重复帧，上一帧已处理
+          cmd_flush();
+          continue;
+        }
+      }
+    }
+
+    drain_input();
+    link_write(STATUS_NAK);
+    link_write(seq);            //请求重发该帧
+    cmd_flush();
+  }
+  return 1;
+}
@@ -0,0 +1,19 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <arduino.h>
+
+/*
+帧格式：序号(1) 长度(1, 0表示256) 数据 CRC16(2, 高字节在前，覆盖序号、长度和数据)
+帧模式下，连续读的数据以帧上传，区间编程的每段数据以帧下发，
+收到错误帧时下位机回传 STATUS_NAK + 期望的序号，上位机只需重发该帧
+*/
+#define FRAME_RETRY 8       //单帧最多重传次数
+
+extern byte frame_mode;     //非0时启用帧模式
+
+void frame_send(byte seq, const byte *data, uint16_t len);
+byte frame_recv(byte seq, byte *data, uint16_t len, byte ack);
+
+
+#endif
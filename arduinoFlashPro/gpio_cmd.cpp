@@ -24,6 +24,8 @@
 #include "defines.h"
 #include "gpio_cmd.h"
 #include "commands.h"
+#include "link.h"
+#include "fast_pin.h"
 
 extern byte buff[buffSize];
 
@@ -32,10 +34,10 @@ void gpio_init() {
   long i2c_speed;
   byte bytesread;
 
-  bytesread = Serial.readBytes(buff, 2);      //从串口读取2字节，指示输入输出及上下拉，共8个IO。
+  bytesread = link_read(buff, 2);      //从串口读取2字节，指示输入输出及上下拉，共8个IO。
   if (bytesread != 2) {
-    Serial.write(ERROR_TIMOUT); //超时
-    Serial.flush();
+    link_write(ERROR_TIMOUT); //超时
+    cmd_flush();
     return;
   }
 
@@ -54,8 +56,8 @@ void gpio_init() {
     }
   }
   
-  Serial.write(FUNC_GPIO_INIT);    //回传cmd给串口
-  Serial.flush();
+  link_write(FUNC_GPIO_INIT);    //回传cmd给串口
+  cmd_flush();
 }
 
 //31 关闭GPIO ----------------------------------------------
@@ -63,8 +65,8 @@ void gpio_deinit() {
   for(byte i = 0;i < 8; i++)
     pinMode(i, INPUT_PULLUP);     //默认切换回输入模式
 
-  Serial.write(FUNC_I2C_DEINIT); //回传cmd给串口
-  Serial.flush();
+  link_write(FUNC_I2C_DEINIT); //回传cmd给串口
+  cmd_flush();
 }
 
 
@@ -72,12 +74,18 @@ void gpio_deinit() {
 void gpio_read(){
   byte bytesret = 0;
 
-  for(byte i = 0;i < 8; i++)
-    bytesret |= digitalRead(i) ? (1 << i) : 0;
+  bytesret |= FastPin<0>::read() ? 0x01 : 0;      //编译期确定端口，逐位读取
+  bytesret |= FastPin<1>::read() ? 0x02 : 0;
+  bytesret |= FastPin<2>::read() ? 0x04 : 0;
+  bytesret |= FastPin<3>::read() ? 0x08 : 0;
+  bytesret |= FastPin<4>::read() ? 0x10 : 0;
+  bytesret |= FastPin<5>::read() ? 0x20 : 0;
+  bytesret |= FastPin<6>::read() ? 0x40 : 0;
+  bytesret |= FastPin<7>::read() ? 0x80 : 0;
   
-  Serial.write(bytesret); //回传IO
-  Serial.write(FUNC_GPIO_READ);   //回传命令码
-  Serial.flush();
+  link_write(bytesret); //回传IO
+  link_write(FUNC_GPIO_READ);   //回传命令码
+  cmd_flush();
 }
 
 
@@ -86,17 +94,23 @@ void gpio_write()
 {
   byte bytesread;
 
-  bytesread = Serial.readBytes(buff, 1);      //从串口读取1字节，指示写入IO
+  bytesread = link_read(buff, 1);      //从串口读取1字节，指示写入IO
 
   if (bytesread == 0) {
-    Serial.write(ERROR_TIMOUT); //超时
-    Serial.flush();
+    link_write(ERROR_TIMOUT); //超时
+    cmd_flush();
     return;
   }
 
-  for(byte i = 0;i < 8; i++)
-    digitalWrite(i, buff[0] & (1 << i) ? HIGH : LOW);
-
-  Serial.write(FUNC_GPIO_WRITE); //回传cmd给串口
-  Serial.flush();
+  FastPin<0>::set(buff[0] & 0x01);     //编译期确定端口，单指令置位/清零
+  FastPin<1>::set(buff[0] & 0x02);
+  FastPin<2>::set(buff[0] & 0x04);
+  FastPin<3>::set(buff[0] & 0x08);
+  FastPin<4>::set(buff[0] & 0x10);
+  FastPin<5>::set(buff[0] & 0x20);
+  FastPin<6>::set(buff[0] & 0x40);
+  FastPin<7>::set(buff[0] & 0x80);
+
+  link_write(FUNC_GPIO_WRITE); //回传cmd给串口
+  cmd_flush();
 }
@@ -0,0 +1,159 @@
+/*
+	该程序基于简易的arduino硬件，主要目的是烧录SPI Flash，如W25QXX等，主要原理是实现了UART转SPI的功能，需配合上位机使用。
+  也可烧录eepron，如24cxx
+  中断驱动的I2C读写队列
+    Copyright (C) 2023  LiHangBing
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+  传输由twi.c中的ISR(TWI_vect)完成（twi_writeToAsync/twi_readFromAsync），每个请求结束时在中断中回调i2c_async_done，
+  由它直接启动队列中的下一个请求，请求之间不需要主循环参与。
+  读请求（起始、地址+读、数据、最后一字节NACK、停止）直接写入调用者的缓冲区，主循环上传上一块的同时中断读取下一块。
+  带poll标志的请求在地址无应答时立即重发（ACK轮询），用于等待EEPROM写周期结束，超时为I2C_EE_TIMEOUT。
+  队列之外的I2C操作（Wire_new的轮询方式函数）必须在队列清空后进行。
+*/
+
+#include <arduino.h>
+#include <util/atomic.h>
+#include "src/Wire_new.h"
+#include "defines.h"
+#include "i2c_async.h"
+
+extern "C" {
+  #include "src/twi/twi.h"
+}
+
+struct i2c_req {
+  byte sla;                       //7位器件地址
+  byte *data;
+  byte len;
+  byte poll;                      //地址无应答时重发
+  byte read;                      //读请求
+};
+
+static i2c_req queue[I2C_QUEUE_LEN];
+static volatile byte q_head;      //当前请求
+static volatile byte q_count;     //队列中的请求数（含当前请求）
+static volatile byte q_error;     //第一个失败请求的结果，同twi_writeTo
+static volatile unsigned long q_start;    //当前请求开始时间
+
+//开始当前请求，TWI未就绪（如twi_stop超时且未复位）时请求无法开始，不会再有完成回调，
+//此时记录错误4并清空队列，i2c_async_wait立即返回，不必等到I2C_ASYNC_TIMEOUT
+static void i2c_async_start()
+{
+  i2c_req *r = &queue[q_head];
+
+  if (r->read ? twi_readFromAsync(r->sla, r->data, r->len) : twi_writeToAsync(r->sla, r->data, r->len)) {
+    if (q_error == 0)
+      q_error = 4;
+    q_count = 0;
+  }
+}
+
+//请求结束，在TWI中断中调用
+static void i2c_async_done(uint8_t result)
+{
+  if (result == 2 && queue[q_head].poll && millis() - q_start < I2C_EE_TIMEOUT) {
+    i2c_async_start();            //写周期未结束，重发
+    return;
+  }
+
+  if (result != 0 && q_error == 0)
+    q_error = result;
+  q_head = (q_head + 1) % I2C_QUEUE_LEN;
+  q_count--;
+  if (q_count > 0) {
+    q_start = millis();
+    i2c_async_start();
+  }
+}
+
+//初始化队列，需在Wire_new.begin之后调用
+void i2c_async_begin()
+{
+  q_head = 0;
+  q_count = 0;
+  q_error = 0;
+  twi_attachMasterDoneEvent(i2c_async_done);
+}
+
+//请求加入队列，队列满时等待，返回值同i2c_async_submit
+static byte i2c_async_push(byte sla, byte *data, byte len, byte poll, byte read)
+{
+  byte i;
+  byte err;
+
+  err = i2c_async_wait(I2C_QUEUE_LEN - 1);
+  if (err)
+    return err;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    i = (q_head + q_count) % I2C_QUEUE_LEN;
+    queue[i].sla = sla;
+    queue[i].data = data;
+    queue[i].len = len;
+    queue[i].poll = poll;
+    queue[i].read = read;
+    q_count++;
+    if (q_count == 1) {           //队列原为空，立即开始
+      q_start = millis();
+      i2c_async_start();
+    }
+  }
+  return 0;
+}
+
+//提交一个写请求（起始、地址+写、数据、停止），队列满时等待
+//返回0成功；非0为之前请求的错误（同i2c_async_wait），此时不提交，队列中可能仍有请求在传输
+//len为0时只发送地址，配合poll用于等待写周期结束
+byte i2c_async_submit(byte sla, byte *data, byte len, byte poll)
+{
+  return i2c_async_push(sla, data, len, poll, 0);
+}
+
+//提交一个读请求，读取len字节（至少1字节）到data，返回值同i2c_async_submit
+byte i2c_async_read(byte sla, byte *data, byte len)
+{
+  return i2c_async_push(sla, data, len, 0, 1);
+}
+
+//等待队列中剩余的请求不超过pending个，返回并清除已完成请求中的第一个错误（同twi_writeTo，0成功），
+//超过I2C_ASYNC_TIMEOUT没有请求完成时复位I2C并清空队列，返回5
+byte i2c_async_wait(byte pending)
+{
+  unsigned long start = millis();
+  byte count = q_count;
+  byte err;
+
+  while (q_count > pending)
+  {
+    if (q_count != count) {       //有请求完成，重新计时
+      count = q_count;
+      start = millis();
+    }
+    if (millis() - start >= I2C_ASYNC_TIMEOUT) {
+      Wire_new.begin();           //总线卡死，重新初始化（关闭TWI中断）
+      i2c_async_begin();
+      return 5;
+    }
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    err = q_error;
+    q_error = 0;
+  }
+  return err;
+}
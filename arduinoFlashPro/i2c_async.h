@@ -0,0 +1,16 @@
+#ifndef I2C_ASYNC_H
+#define I2C_ASYNC_H
+
+#include <arduino.h>
+
+//中断驱动的I2C读写队列：提交后立即返回，由TWI中断依次完成，主循环可同时收发串口数据
+//请求的数据不复制，传输完成前调用者不能修改（读请求完成前不能读取）
+#define I2C_QUEUE_LEN 2           //队列长度，EEPROM写入和连续读时双缓冲已足够
+
+void i2c_async_begin();
+byte i2c_async_submit(byte sla, byte *data, byte len, byte poll);
+byte i2c_async_read(byte sla, byte *data, byte len);
+byte i2c_async_wait(byte pending);
+
+
+#endif
@@ -24,6 +24,9 @@
 #include "defines.h"
 #include "i2c_cmd.h"
 #include "commands.h"
+#include "link.h"
+#include "frame.h"
+#include "i2c_async.h"
 
 extern byte buff[buffSize];
 
@@ -32,10 +35,10 @@ void i2c_cmd_init() {
   long i2c_speed;
   byte bytesread;
 
-  bytesread = Serial.readBytes(buff, 1);      //从串口读取1字节，指示I2C时钟速度
+  bytesread = link_read(buff, 1);      //从串口读取1字节，指示I2C时钟速度
   if (bytesread == 0) {
-    Serial.write(ERROR_TIMOUT); //超时
-    Serial.flush();
+    link_write(ERROR_TIMOUT); //超时
+    cmd_flush();
     return;
   }
 
@@ -52,16 +55,16 @@ void i2c_cmd_init() {
       break;
 
     default:
-      Serial.write(ERROR_RECV); //接收错误
-      Serial.flush();
+      link_write(ERROR_RECV); //接收错误
+      cmd_flush();
       return;
   }
 
   Wire_new.begin();
   Wire_new.setClock(i2c_speed);
   
-  Serial.write(FUNC_I2C_INIT);    //回传cmd给串口
-  Serial.flush();
+  link_write(FUNC_I2C_INIT);    //回传cmd给串口
+  cmd_flush();
 }
 
 //21 关闭I2C ----------------------------------------------
@@ -70,8 +73,8 @@ void i2c_cmd_deinit() {
   //Wire_new.endTransmission();
   Wire_new.end();
 
-  Serial.write(FUNC_I2C_DEINIT); //回传cmd给串口
-  Serial.flush();
+  link_write(FUNC_I2C_DEINIT); //回传cmd给串口
+  cmd_flush();
 }
 
 
@@ -82,10 +85,10 @@ void i2c_cmd_start(){
   bytesret = Wire_new.sendStart();     //发送起始信号
   
   if(bytesret == 0)
-    Serial.write(FUNC_I2C_START); //回传命令码
+    link_write(FUNC_I2C_START); //回传命令码
   else
-    Serial.write(ERROR_OPERAT);   //收到NACK或超时
-  Serial.flush();
+    link_write(ERROR_OPERAT);   //收到NACK或超时
+  cmd_flush();
 }
 
 
@@ -95,8 +98,8 @@ void i2c_cmd_stop()
 {
   Wire_new.sendStop();
 
-  Serial.write(FUNC_I2C_STOP); //回传cmd给串口
-  Serial.flush();
+  link_write(FUNC_I2C_STOP); //回传cmd给串口
+  cmd_flush();
 }
 
 
@@ -109,33 +112,33 @@ void i2c_cmd_read() {
   byte nack_last;
   byte bytesret;
 
-  bytesread = Serial.readBytes(buff, 2);      //从串口读取2字节，指示读取的长度,和最后是否NACK，最大BUFFER_LENGTH（32） 串口缓冲区长度64，因此无需考虑串口缓冲区长度
+  bytesread = link_read(buff, 2);      //从串口读取2字节，指示读取的长度,和最后是否NACK，最大BUFFER_LENGTH（32） 不超过buffSize
   if (bytesread != 2) {
-    Serial.write(ERROR_TIMOUT); //超时
-    Serial.flush();
+    link_write(ERROR_TIMOUT); //超时
+    cmd_flush();
     return;
   }
 
   bytesread = buff[0];
   nack_last = buff[1];
   if(bytesread > BUFFER_LENGTH){
-    Serial.write(ERROR_RECV);   //命令错误
-    Serial.flush();
+    link_write(ERROR_RECV);   //命令错误
+    cmd_flush();
     return;
   }
 
-  Serial.write(FUNC_I2C_READ); //回传命令码
-  Serial.flush();
+  link_write(FUNC_I2C_READ); //回传命令码
+  cmd_flush();
 
   bytesret = Wire_new.readData(buff, bytesread, nack_last);     //读数据
-  Serial.write(buff, bytesread);   //上传读取的数据
-  Serial.flush();         //刷新缓冲区
+  link_write(buff, bytesread);   //上传读取的数据
+  cmd_flush();         //刷新缓冲区
 
   if(bytesret == 0)
-    Serial.write(FUNC_I2C_READ); //回传命令码
+    link_write(FUNC_I2C_READ); //回传命令码
   else
-    Serial.write(ERROR_OPERAT);   //收到NACK或超时,读取失败
-  Serial.flush();
+    link_write(ERROR_OPERAT);   //收到NACK或超时,读取失败
+  cmd_flush();
 }
 
 //22 I2C写
@@ -144,37 +147,37 @@ void i2c_cmd_write() {
   byte bytesread;
   byte bytesret;
 
-  bytesread = Serial.readBytes(buff, 1);      //从串口读取1字节，指示写入的长度,最大BUFFER_LENGTH（32） 串口缓冲区长度64，因此无需考虑串口缓冲区长度
+  bytesread = link_read(buff, 1);      //从串口读取1字节，指示写入的长度,最大BUFFER_LENGTH（32） 不超过buffSize
   if (bytesread == 0) {
-    Serial.write(ERROR_TIMOUT); //超时
-    Serial.flush();
+    link_write(ERROR_TIMOUT); //超时
+    cmd_flush();
     return;
   }
 
   byteswrite = buff[0];
   if(byteswrite > BUFFER_LENGTH){
-    Serial.write(ERROR_RECV);   //命令错误
-    Serial.flush();
+    link_write(ERROR_RECV);   //命令错误
+    cmd_flush();
     return;
   }
 
-  Serial.write(FUNC_I2C_WRITE); //回传命令码
-  Serial.flush();
+  link_write(FUNC_I2C_WRITE); //回传命令码
+  cmd_flush();
 
-  bytesread = Serial.readBytes(buff, byteswrite); //从串口读取要写入的数据
+  bytesread = link_read(buff, byteswrite); //从串口读取要写入的数据
   if (byteswrite != bytesread) {
-    Serial.write(ERROR_RECV);
-    Serial.flush();
+    link_write(ERROR_RECV);
+    cmd_flush();
     return;
   }
 
   bytesret = Wire_new.writeData(buff, byteswrite);     //写入数据，并获取ack
 
   if(bytesret == 0)
-    Serial.write(FUNC_I2C_WRITE); //回传命令码
+    link_write(FUNC_I2C_WRITE); //回传命令码
   else
-    Serial.write(ERROR_OPERAT);   //收到NACK或超时，i2c写入失败
-  Serial.flush();
+    link_write(ERROR_OPERAT);   //收到NACK或超时，i2c写入失败
+  cmd_flush();
 }
 
 
@@ -183,17 +186,286 @@ void i2c_cmd_tst()
 {
   byte bytesread;
 
-  Serial.write(0xa5);
-  Serial.write(0x5a);
-  Serial.flush();         //发送两个识别码
+  link_write(0xa5);
+  link_write(0x5a);
+  cmd_flush();         //发送两个识别码
 
-  bytesread = Serial.readBytes(buff, 2);  //接收两个识别码
+  bytesread = link_read(buff, 2);  //接收两个识别码
   if (bytesread != 2 || buff[0] != 0xa5 || buff[1] != 0x5a) {
-    Serial.write(ERROR_RECV);
-    Serial.flush();
+    link_write(ERROR_RECV);
+    cmd_flush();
     return;
   }
   
-  Serial.write(FUNC_I2C_TST); //回传命令码
-  Serial.flush();
+  link_write(FUNC_I2C_TST); //回传命令码
+  cmd_flush();
+}
+
+//高字节在前的32位数
+static uint32_t i2c_get_u32(const byte *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+//EEPROM的器件地址：内存地址超出地址字节的高位（最多3位）放在器件地址的低位（如24C16、24CM01）
+static byte i2c_ee_sla(byte dev, byte addr_width, uint32_t addr)
+{
+  return dev | ((byte)(addr >> (addr_width * 8)) & 0x07);
+}
+
+static byte ee_buf[2][buffSize + 2];      //EEPROM写入双缓冲：内存地址(1~2) + 一页数据；连续读时每个缓冲区存放一块
+
+//26 EEPROM区间写命令，按页边界拆分，每页写入后用ACK轮询等待写周期结束 -----------------------------------------
+//参数：器件地址(1, 7位，如0x50) 地址字节数(1, 1或2) 页大小(1, 2的幂，不超过buffSize) 地址(4) 长度(4)
+//流程与FUNC_SPI_PROGRAM相同：回传命令码后，上位机按页边界拆分发送数据，每段提交写入后回传一次命令码，
+//      最后一段写周期结束后才回传命令码；帧模式下每段为一帧
+//每段提交到中断驱动的写队列（i2c_async.h）后即可接收下一段，串口接收与上一段的I2C传输、写周期同时进行，
+//两段之间的ACK轮询也在中断中完成
+void i2c_cmd_ee_write() {
+  byte bytesread;
+  byte seq = 0;
+  byte dev;
+  byte addr_width;
+  byte page;
+  byte *b;
+  uint32_t addr;
+  uint32_t len;
+  uint16_t n;
+
+  bytesread = link_read(buff, 11);  //器件地址、地址字节数、页大小、地址、长度
+  if (bytesread != 11) {
+    link_write(ERROR_TIMOUT); //超时
+    cmd_flush();
+    return;
+  }
+
+  dev = buff[0];
+  addr_width = buff[1];
+  page = buff[2];
+  addr = i2c_get_u32(buff + 3);
+  len = i2c_get_u32(buff + 7);
+  if (dev > 0x7f || (addr_width != 1 && addr_width != 2) ||
+      page == 0 || (page & (page - 1)) || page > buffSize) {
+    link_write(ERROR_RECV);   //命令错误
+    cmd_flush();
+    return;
+  }
+
+  i2c_async_begin();
+  link_write(FUNC_I2C_EE_WRITE); //回传命令码，上位机开始发送第一段
+  cmd_flush();
+
+  while (len > 0)
+  {
+    n = page - (addr & (page - 1));     //本页剩余空间
+    if (n > len)
+      n = len;
+
+    if (i2c_async_wait(1)) {            //两段之前的缓冲区必须已写完才能覆盖
+      i2c_async_wait(0);                //出错时也要等队列清空，不能在TWI中断仍在传输时返回
+      link_write(ERROR_OPERAT);         //无应答或写入时收到NACK
+      cmd_flush();
+      return;
+    }
+
+    b = ee_buf[seq & 1];
+    if (frame_mode ? frame_recv(seq, b + addr_width, n, FUNC_I2C_EE_WRITE) : link_read(b + addr_width, n) != n) {      //接收本段数据
+      i2c_async_wait(0);
+      link_write(ERROR_TIMOUT);
+      cmd_flush();
+      return;
+    }
+    seq++;
+
+    if (addr_width == 2) {
+      b[0] = addr >> 8;
+      b[1] = addr;
+    } else {
+      b[0] = addr;
+    }
+    if (i2c_async_submit(i2c_ee_sla(dev, addr_width, addr), b, addr_width + n, 1)) {   //上一页写周期未结束时在中断中ACK轮询
+      i2c_async_wait(0);
+      link_write(ERROR_OPERAT);
+      cmd_flush();
+      return;
+    }
+
+    addr += n;
+    len -= n;
+    if (len == 0) {                     //最后一段需等待写周期结束后再应答（只发送地址的ACK轮询）
+      if (i2c_async_submit(i2c_ee_sla(dev, addr_width, addr - n), NULL, 0, 1) || i2c_async_wait(0)) {
+        i2c_async_wait(0);
+        link_write(ERROR_OPERAT);
+        cmd_flush();
+        return;
+      }
+    }
+
+    link_write(FUNC_I2C_EE_WRITE); //本段已开始写入，上位机可发送下一段
+    cmd_flush();
+  }
+}
+
+//组合传输的状态
+#define XFER_OK         0
+#define XFER_W_NACK     1       //写地址无应答（或起始信号失败）
+#define XFER_DATA_NACK  2       //写数据收到NACK
+#define XFER_R_NACK     3       //读地址无应答（或重复起始信号失败）
+#define XFER_READ_FAIL  4       //读取超时
+
+//27 I2C组合传输命令，一条命令完成 起始、地址+写、写数据、重复起始、地址+读、读数据（最后一字节NACK）、停止 -----------------------------------------
+//参数：器件地址(1, 7位) 写长度(1) 读长度(1) 写数据，长度均不超过buffSize；写长度为0时只读，读长度为0时只写
+//上位机一次发送全部参数和数据，无需等待回传
+//回传：命令码、状态(1, 见XFER_*)、读出的数据(读长度，失败时内容无效)；参数错误时只回传错误码
+void i2c_cmd_xfer() {
+  byte bytesread;
+  byte sla;
+  byte wlen;
+  byte rlen;
+  byte status = XFER_OK;
+
+  bytesread = link_read(buff, 3);  //器件地址、写长度、读长度
+  if (bytesread != 3) {
+    link_write(ERROR_TIMOUT); //超时
+    cmd_flush();
+    return;
+  }
+
+  sla = buff[0] << 1;
+  wlen = buff[1];
+  rlen = buff[2];
+  if (buff[0] > 0x7f || wlen > buffSize || rlen > buffSize || (wlen == 0 && rlen == 0)) {
+    link_write(ERROR_RECV);   //命令错误
+    cmd_flush();
+    return;
+  }
+
+  bytesread = link_read(buff, wlen);   //要写入的数据
+  if (bytesread != wlen) {
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
+    return;
+  }
+
+  if (wlen > 0) {
+    if (Wire_new.sendStart() || Wire_new.writeData(&sla, 1))
+      status = XFER_W_NACK;
+    else if (Wire_new.writeData(buff, wlen))
+      status = XFER_DATA_NACK;
+  }
+
+  if (status == XFER_OK && rlen > 0) {
+    sla |= 0x01;
+    if (Wire_new.sendStart() || Wire_new.writeData(&sla, 1))   //写之后为重复起始信号
+      status = XFER_R_NACK;
+    else if (Wire_new.readData(buff, rlen, 1))
+      status = XFER_READ_FAIL;
+  }
+  Wire_new.sendStop();
+
+  link_write(FUNC_I2C_XFER); //回传命令码
+  link_write(status);
+  link_write(buff, rlen);    //上传读取的数据
+  cmd_flush();
+}
+
+static byte stream_seq;         //帧模式下的帧序号
+
+//上传连续读的一块，帧模式下每块为一帧
+static void i2c_stream_put(const byte *data, byte n)
+{
+  if (frame_mode)
+    frame_send(stream_seq++, data, n);
+  else
+    link_write(data, n);
+}
+
+//29 I2C连续读命令（EEPROM转储），长度不受buffSize限制 -----------------------------------------
+//参数：器件地址(1, 7位) 地址字节数(1, 0~2，0表示从当前地址读) 地址(4) 长度(4)
+//流程：写入内存地址后，每buffSize字节为一次中断驱动的读传输（最后一字节NACK后停止），下一块从当前地址继续，
+//      两块交替使用ee_buf，上传一块的同时TWI中断读取下一块
+//回传：命令码、数据(长度字节)、命令码；失败时剩余数据以0xFF补齐，尾部为ERROR_OPERAT
+//帧模式下每块数据（buffSize字节）为一帧，序号从0开始，与FUNC_SPI_READ_BULK相同
+void i2c_cmd_read_stream() {
+  byte bytesread;
+  byte dev;
+  byte addr_width;
+  byte sla;
+  byte mem[2];
+  byte ret = 0;
+  byte n;
+  byte k = 0;
+  uint32_t addr;
+  uint32_t len;
+  uint32_t done = 0;              //已上传的字节数
+  uint32_t req = 0;               //已提交读请求的字节数
+
+  bytesread = link_read(buff, 10);  //器件地址、地址字节数、地址、长度
+  if (bytesread != 10) {
+    link_write(ERROR_TIMOUT); //超时
+    cmd_flush();
+    return;
+  }
+
+  dev = buff[0];
+  addr_width = buff[1];
+  addr = i2c_get_u32(buff + 2);
+  len = i2c_get_u32(buff + 6);
+  if (dev > 0x7f || addr_width > 2) {
+    link_write(ERROR_RECV);   //命令错误
+    cmd_flush();
+    return;
+  }
+
+  link_write(FUNC_I2C_READ_STREAM); //回传命令码，之后开始连续上传数据
+  cmd_flush();
+
+  i2c_async_begin();
+  stream_seq = 0;
+  sla = addr_width ? i2c_ee_sla(dev, addr_width, addr) : dev;
+  if (addr_width > 0) {
+    mem[0] = addr >> 8;
+    mem[1] = addr;
+    ret = i2c_async_submit(sla, mem + 2 - addr_width, addr_width, 0);   //只写地址后停止，之后从当前地址读
+  }
+
+  if (ret == 0 && len > 0) {
+    req = len > buffSize ? buffSize : len;
+    ret = i2c_async_read(sla, ee_buf[0], req);
+  }
+
+  while (ret == 0 && done < len)
+  {
+    n = len - done > buffSize ? buffSize : len - done;      //本块
+    if (req < len) {                  //先提交下一块，本块上传期间由中断读取
+      byte m = len - req > buffSize ? buffSize : len - req;
+      ret = i2c_async_read(sla, ee_buf[(k + 1) & 1], m);
+      if (ret)
+        break;
+      req += m;
+    }
+
+    ret = i2c_async_wait(req > done + n ? 1 : 0);   //等待本块读完
+    if (ret)
+      break;
+    i2c_stream_put(ee_buf[k & 1], n);
+    done += n;
+    k++;
+  }
+  i2c_async_wait(0);                //出错时也要等队列清空，ee_buf不能在中断仍在写入时复用
+
+  memset(buff, 0xff, buffSize);
+  while (done < len)                //失败时补齐，保证上位机收到的数据长度不变
+  {
+    n = len - done > buffSize ? buffSize : len - done;
+    i2c_stream_put(buff, n);
+    done += n;
+  }
+  cmd_flush();
+
+  if (ret == 0)
+    link_write(FUNC_I2C_READ_STREAM); //尾部状态
+  else
+    link_write(ERROR_OPERAT);   //收到NACK或超时
+  cmd_flush();
 }
@@ -11,6 +11,9 @@ void i2c_cmd_stop();
 void i2c_cmd_read();
 void i2c_cmd_write();
 void i2c_cmd_tst();
+void i2c_cmd_ee_write();
+void i2c_cmd_xfer();
+void i2c_cmd_read_stream();
 
 
 
@@ -0,0 +1,285 @@
+/*
+	该程序基于简易的arduino硬件，主要目的是烧录SPI Flash，如W25QXX等，主要原理是实现了UART转SPI的功能，需配合上位机使用。
+  也可烧录eepron，如24cxx
+  与上位机通信的链路层
+    Copyright (C) 2023  LiHangBing
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+  USB CDC下Serial.readBytes每个字节都要经过 timedRead -> read -> USB_Recv，每次都要锁定端点、
+  检查包内剩余字节，一个64字节的包需要重复64次；这里直接调用USB_Recv一次取出当前包内的全部数据。
+  发送方向Serial.write(buf, n)已经是USB_Send整块发送，这里直接调用以省去一层虚函数。
+  波特率对USB CDC没有意义，link_begin只保留接口一致。
+  link_unread放回的字节（主循环非阻塞收齐的命令参数头）在两种实现中都先于新数据读出。
+*/
+
+#include <arduino.h>
+#include <util/atomic.h>
+#include "link.h"
+#include "defines.h"
+
+static byte unread_buf[LINK_UNREAD_SIZE];
+static byte unread_pos;             //放回缓冲区的读取位置
+static byte unread_len;
+
+//放回已读出的字节，之后的读取先返回这些字节（放在尚未读完的放回字节之前）
+void link_unread(const byte *buf, byte len)
+{
+  byte rest = unread_len - unread_pos;
+
+  memmove(unread_buf + len, unread_buf + unread_pos, rest);
+  memcpy(unread_buf, buf, len);
+  unread_pos = 0;
+  unread_len = len + rest;
+}
+
+//从放回缓冲区取出最多len字节，返回取出的长度
+static uint16_t unread_take(byte *buf, uint16_t len)
+{
+  uint16_t n = unread_len - unread_pos;
+
+  if (n > len)
+    n = len;
+  memcpy(buf, unread_buf + unread_pos, n);
+  unread_pos += n;
+  return n;
+}
+
+#if defined(USBCON)
+
+void link_begin(unsigned long baud)
+{
+  Serial.begin(baud);
+}
+
+void link_end()
+{
+  Serial.end();
+  unread_pos = unread_len = 0;
+}
+
+int link_available()
+{
+  return unread_len - unread_pos + USB_Available(CDC_RX);
+}
+
+//读取一个字节，没有数据时返回-1
+int link_read_byte()
+{
+  if (unread_pos < unread_len)
+    return unread_buf[unread_pos++];
+  if (USB_Available(CDC_RX) == 0)
+    return -1;
+  return USB_Recv(CDC_RX);
+}
+
+//读取len字节，每次取出端点FIFO中的全部可用数据，超过LINK_TIMEOUT没有新数据时返回已读取的长度
+uint16_t link_read(byte *buf, uint16_t len)
+{
+  uint16_t count = unread_take(buf, len);
+  unsigned long start = millis();
+  int n;
+
+  while (count < len)
+  {
+    n = USB_Recv(CDC_RX, buf + count, len - count);
+    if (n > 0) {
+      count += n;
+      start = millis();
+    } else if (millis() - start >= LINK_TIMEOUT) {
+      break;
+    }
+  }
+  return count;
+}
+
+void link_write(byte data)
+{
+  USB_Send(CDC_TX, &data, 1);
+}
+
+//整块写入端点，每满64字节发出一个包
+void link_write(const byte *buf, uint16_t len)
+{
+  USB_Send(CDC_TX, buf, len);
+}
+
+//立即发出未满的包（否则等到下一个SOF才发出）
+void link_flush()
+{
+  USB_Flush(CDC_TX);
+}
+
+#else
+
+/*
+  不使用HardwareSerial（引用Serial会链接其中的USART中断，与这里冲突），中断只负责在环形缓冲区与UDR0之间搬运字节，
+  link_read/link_write按连续段整块memcpy，缓冲区大小见defines.h中的LINK_RX_SIZE/LINK_TX_SIZE
+*/
+
+#if defined(USART_RX_vect)
+#define LINK_RX_vect    USART_RX_vect
+#define LINK_UDRE_vect  USART_UDRE_vect
+#else
+#define LINK_RX_vect    USART0_RX_vect
+#define LINK_UDRE_vect  USART0_UDRE_vect
+#endif
+
+#define RX_MASK (LINK_RX_SIZE - 1)
+#define TX_MASK (LINK_TX_SIZE - 1)
+
+static byte rx_buf[LINK_RX_SIZE];
+static byte tx_buf[LINK_TX_SIZE];
+static volatile byte rx_head;       //中断写入位置
+static volatile byte rx_tail;       //读取位置
+static volatile byte tx_head;       //写入位置
+static volatile byte tx_tail;       //中断发送位置
+static bool written;                //开始后是否发送过数据，link_flush据此判断是否需要等待TXC0
+
+ISR(LINK_RX_vect)
+{
+  byte c = UDR0;                    //出错的字节也必须读出以清除RXC0
+  byte next = (byte)(rx_head + 1) & RX_MASK;
+
+  if (next != rx_tail) {            //缓冲区满时丢弃
+    rx_buf[rx_head] = c;
+    rx_head = next;
+  }
+}
+
+ISR(LINK_UDRE_vect)
+{
+  byte t = tx_tail;
+
+  UDR0 = tx_buf[t];
+  UCSR0A = (UCSR0A & (_BV(U2X0) | _BV(MPCM0))) | _BV(TXC0);   //清除TXC0（写1清除）
+  t = (byte)(t + 1) & TX_MASK;
+  tx_tail = t;
+  if (t == tx_head)
+    UCSR0B &= ~_BV(UDRIE0);         //发送完毕，关闭空中断
+}
+
+//波特率计算与HardwareSerial::begin相同（U2X0倍速模式），见defines.h
+void link_begin(unsigned long baud)
+{
+  UCSR0A = _BV(U2X0);
+  UBRR0 = (F_CPU / 4 / baud - 1) / 2;
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);         //8N1
+  rx_head = rx_tail = 0;
+  tx_head = tx_tail = 0;
+  written = false;
+  UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+}
+
+//关闭USART，接收缓冲区中未读的数据被丢弃
+void link_end()
+{
+  link_flush();
+  UCSR0B = 0;
+  rx_head = rx_tail;
+  unread_pos = unread_len = 0;
+}
+
+int link_available()
+{
+  return unread_len - unread_pos + ((byte)(rx_head - rx_tail) & RX_MASK);
+}
+
+//读取一个字节，没有数据时返回-1
+int link_read_byte()
+{
+  byte c;
+
+  if (unread_pos < unread_len)
+    return unread_buf[unread_pos++];
+  if (rx_head == rx_tail)
+    return -1;
+  c = rx_buf[rx_tail];
+  rx_tail = (byte)(rx_tail + 1) & RX_MASK;
+  return c;
+}
+
+//读取len字节，每次整块复制缓冲区中连续的一段，超过LINK_TIMEOUT没有新数据时返回已读取的长度
+uint16_t link_read(byte *buf, uint16_t len)
+{
+  uint16_t count = unread_take(buf, len);
+  unsigned long start = millis();
+  byte head;
+  uint16_t n;
+
+  while (count < len)
+  {
+    head = rx_head;
+    if (head == rx_tail) {
+      if (millis() - start >= LINK_TIMEOUT)
+        break;
+      continue;
+    }
+
+    n = (head > rx_tail ? head : LINK_RX_SIZE) - rx_tail;   //到缓冲区末尾或写入位置为止
+    if (n > len - count)
+      n = len - count;
+    memcpy(buf + count, rx_buf + rx_tail, n);
+    rx_tail = (byte)(rx_tail + n) & RX_MASK;
+    count += n;
+    start = millis();
+  }
+  return count;
+}
+
+void link_write(byte data)
+{
+  link_write(&data, 1);
+}
+
+//写入len字节，缓冲区满时等待中断发出
+void link_write(const byte *buf, uint16_t len)
+{
+  byte tail;
+  uint16_t n;
+
+  written = true;
+  while (len > 0)
+  {
+    tail = tx_tail;
+    n = (byte)(tail - tx_head - 1) & TX_MASK;       //剩余空间
+    if (n == 0)
+      continue;
+    if (n > LINK_TX_SIZE - tx_head)
+      n = LINK_TX_SIZE - tx_head;                   //到缓冲区末尾为止
+    if (n > len)
+      n = len;
+
+    memcpy(tx_buf + tx_head, buf, n);
+    buf += n;
+    len -= n;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      tx_head = (byte)(tx_head + n) & TX_MASK;
+      UCSR0B |= _BV(UDRIE0);
+    }
+  }
+}
+
+//等待发送完成
+void link_flush()
+{
+  if (!written)
+    return;
+  while (tx_head != tx_tail || !(UCSR0A & _BV(TXC0)))
+    ;
+}
+
+#endif
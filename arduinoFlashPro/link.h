@@ -0,0 +1,24 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <arduino.h>
+
+//与上位机通信的链路层，命令处理函数均通过这里收发数据
+//ATmega32U4（USB CDC）直接读写USB端点FIFO，一次处理一整个64字节的包，不经过Serial逐字节的Stream接口
+//其他芯片直接驱动USART0，收发均为中断驱动的环形缓冲区，大小见defines.h
+
+#define LINK_TIMEOUT 1000       //等待数据流的最大时间间隔 ms 若稳定性差试试提高这个间隔
+#define LINK_UNREAD_SIZE 16     //放回缓冲区长度，不小于最长的命令参数头（含流水线标签）
+
+void link_begin(unsigned long baud);
+void link_end();
+int link_available();
+int link_read_byte();
+uint16_t link_read(byte *buf, uint16_t len);
+void link_write(byte data);
+void link_write(const byte *buf, uint16_t len);
+void link_flush();
+void link_unread(const byte *buf, byte len);
+
+
+#endif
@@ -0,0 +1,85 @@
+/*
+	该程序基于简易的arduino硬件，主要目的是烧录SPI Flash，如W25QXX等，主要原理是实现了UART转SPI的功能，需配合上位机使用。
+  也可烧录eepron，如24cxx
+  USART1 SPI主机模式（MSPIM），作为第二路SPI
+    Copyright (C) 2023  LiHangBing
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <arduino.h>
+#include "mspim.h"
+
+#if defined(MSPIM_AVAILABLE)
+
+//初始化MSPIM，SPI模式0，高位在前，时钟为F_CPU/div（div为2~128的偶数）
+void mspim_init(byte div)
+{
+  UBRR1 = 0;
+  DDRD |= _BV(5);                             //XCK1输出（主机模式必须）
+  UCSR1C = _BV(UMSEL11) | _BV(UMSEL10);       //MSPIM，UCPOL1=0 UCPHA1=0 即模式0，UDORD1=0 高位在前
+  UCSR1B = _BV(RXEN1) | _BV(TXEN1);
+  UBRR1 = div / 2 - 1;                        //波特率 = F_CPU / (2 * (UBRR1 + 1))，须在使能发送后设置
+}
+
+//关闭MSPIM，引脚恢复为输入
+void mspim_end()
+{
+  UCSR1B = 0;
+  UCSR1C = 0;
+  DDRD &= ~_BV(5);
+}
+
+//读取len字节，MOSI固定输出0xFF
+//发送缓冲区为双缓冲，始终提前写入下一字节，总线上字节之间没有空闲
+void mspim_read_buf(byte *buf, uint16_t len)
+{
+  uint16_t sent = 0;
+
+  while (len > 0)
+  {
+    if (sent < len && sent < 2 && (UCSR1A & _BV(UDRE1))) {
+      UDR1 = 0xff;
+      sent++;
+    }
+    if (UCSR1A & _BV(RXC1)) {
+      *buf++ = UDR1;
+      sent--;
+      len--;
+    }
+  }
+}
+
+//写入len字节，丢弃读回的数据
+void mspim_write_buf(const byte *buf, uint16_t len)
+{
+  uint16_t pending = 0;
+
+  while (len > 0 || pending > 0)
+  {
+    if (len > 0 && pending < 2 && (UCSR1A & _BV(UDRE1))) {
+      UDR1 = *buf++;
+      len--;
+      pending++;
+    }
+    if (UCSR1A & _BV(RXC1)) {
+      (void)UDR1;               //接收缓冲区只有2级，必须及时读出
+      pending--;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef MSPIM_H
+#define MSPIM_H
+
+#include <arduino.h>
+
+//USART1工作在SPI主机模式（MSPIM）作为第二路SPI，仅带USART1的芯片可用（如Leonardo的ATmega32U4，
+//主机链路为USB CDC，Serial1空闲）
+//引脚：MOSI=TXD1(D1/PD3) MISO=RXD1(D0/PD2) SCK=XCK1(PD5，Leonardo上为TX LED引脚)
+#if defined(UBRR1H)
+#define MSPIM_AVAILABLE 1
+
+void mspim_init(byte div);
+void mspim_end();
+void mspim_read_buf(byte *buf, uint16_t len);
+void mspim_write_buf(const byte *buf, uint16_t len);
+
+//交换一个字节
+static inline byte mspim_transfer(byte data)
+{
+  while (!(UCSR1A & _BV(UDRE1)))
+    ;
+  UDR1 = data;
+  while (!(UCSR1A & _BV(RXC1)))
+    ;
+  return UDR1;
+}
+#endif
+
+
+#endif
@@ -0,0 +1,104 @@
+/*
+	该程序基于简易的arduino硬件，主要目的是烧录SPI Flash，如W25QXX等，主要原理是实现了UART转SPI的功能，需配合上位机使用。
+  也可烧录eepron，如24cxx
+  读回数据的游程压缩
+    Copyright (C) 2023  LiHangBing
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <arduino.h>
+#include "rle.h"
+#include "link.h"
+
+static byte lit[128];           //待发送的原样字节
+static byte lit_n;
+static byte run_val;            //当前重复字节
+static uint32_t run_n;          //当前重复次数（最多65536）
+
+static void flush_lit()
+{
+  if (lit_n == 0)
+    return;
+  link_write(lit_n - 1);
+  link_write(lit, lit_n);
+  lit_n = 0;
+}
+
+//结束当前的重复段：3次以上编码为重复，否则并入原样字节
+static void flush_run()
+{
+  if (run_n >= 3) {
+    flush_lit();
+    if (run_n <= 128) {
+      link_write(0x80 + run_n - 3);
+    }
+    else {
+      link_write(0xff);
+      link_write((byte)((run_n - 1) >> 8));
+      link_write((byte)(run_n - 1));
+    }
+    link_write(run_val);
+  }
+  else {
+    while (run_n > 0) {
+      lit[lit_n++] = run_val;
+      if (lit_n == sizeof(lit))
+        flush_lit();
+      run_n--;
+    }
+  }
+  run_n = 0;
+}
+
+//开始一段新的压缩流
+void rle_begin()
+{
+  lit_n = 0;
+  run_n = 0;
+}
+
+//压缩并发送数据，可分段调用
+void rle_put(const byte *data, byte len)
+{
+  while (len--)
+  {
+    byte b = *data++;
+    if (run_n > 0 && b == run_val) {
+      if (++run_n == 65536UL)
+        flush_run();
+      continue;
+    }
+    flush_run();
+    run_val = b;
+    run_n = 1;
+  }
+}
+
+//本块与上一块（RLE_BLOCK字节）完全相同
+void rle_repeat_block()
+{
+  flush_run();
+  flush_lit();
+  link_write(0xfe);
+}
+
+//结束压缩流，发送剩余数据
+void rle_end()
+{
+  flush_run();
+  flush_lit();
+}
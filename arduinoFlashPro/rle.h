@@ -0,0 +1,21 @@
+#ifndef RLE_H
+#define RLE_H
+
+#include <arduino.h>
+
+/*
+压缩流格式（连续读的压缩模式使用）：
+  0x00-0x7F  c+1个原样字节，其后跟数据
+  0x80-0xFD  c-0x80+3个相同字节（3~128），其后跟该字节
+  0xFE       重复前一块，即复制输出末尾的RLE_BLOCK个字节
+  0xFF       长重复，其后跟2字节长度-1（高字节在前，最长65536）和该字节
+*/
+#define RLE_BLOCK 64              //不能超过buffSize
+
+void rle_begin();
+void rle_put(const byte *data, byte len);
+void rle_repeat_block();
+void rle_end();
+
+
+#endif
@@ -24,18 +24,60 @@
 #include "defines.h"
 #include "spi_cmd.h"
 #include "commands.h"
+#include "link.h"
+#include "crc.h"
+#include "rle.h"
+#include "frame.h"
+#include "spi_fast.h"
+#include "fast_pin.h"
 
 extern byte buff[buffSize];
 
+static byte cs_mask = 0x01;       //当前选中的片选，bit0~bit3对应ISP_RST、ISP_CS1~ISP_CS3
+static byte cs_held;              //当前拉低的CS引脚，命令之间非0表示上位机正在手动控制CS（FUNC_SPI_CE等）
+
+//拉低mask中的CS引脚，多片同时拉低时写入的数据广播到所有芯片
+static inline void cs_low(byte mask)
+{
+  if (mask & 0x01) CsPin0::low();
+  if (mask & 0x02) CsPin1::low();
+  if (mask & 0x04) CsPin2::low();
+  if (mask & 0x08) CsPin3::low();
+  cs_held |= mask;
+}
+
+//释放mask中的CS引脚
+static inline void cs_high(byte mask)
+{
+  if (mask & 0x01) CsPin0::high();
+  if (mask & 0x02) CsPin1::high();
+  if (mask & 0x04) CsPin2::high();
+  if (mask & 0x08) CsPin3::high();
+  cs_held &= ~mask;
+}
+
+//读操作只能选中一片（多片同时输出会冲突），取选中的最低位
+static inline byte cs_first()
+{
+  return cs_mask & (byte)(-cs_mask);
+}
+
+//读取前释放除最低位一片以外已拉低的CS，群烧时FUNC_SPI_CE/FUNC_SPI_XFER会拉低全部选中的CS，
+//多片同时驱动MISO会冲突，读出的数据只能来自一片
+static inline void cs_read_only()
+{
+  cs_high(cs_held & ~cs_first());
+}
+
 //7 SPI初始化 ----------------------------------------------
 void spi_cmd_init() {
   long spi_speed;
   byte bytesread;
   
-  bytesread = Serial.readBytes(buff, 1);      //从串口读取1字节，指示SPI时钟速度
+  bytesread = link_read(buff, 1);      //从串口读取1字节，指示SPI时钟速度
   if (bytesread == 0) {
-    Serial.write(ERROR_TIMOUT); //超时
-    Serial.flush();
+    link_write(ERROR_TIMOUT); //超时
+    cmd_flush();
     return;
   }
 
@@ -52,8 +94,8 @@ void spi_cmd_init() {
       break;
 
     default:
-      Serial.write(ERROR_RECV); //接收错误
-      Serial.flush();
+      link_write(ERROR_RECV); //接收错误
+      cmd_flush();
       return;
   }
 
@@ -62,65 +104,73 @@ void spi_cmd_init() {
   pinMode(ISP_RST, OUTPUT);     //CE引脚
   
 
-  Serial.write(FUNC_SPI_INIT); //回传cmd给串口（7）
-  Serial.flush();
+  link_write(FUNC_SPI_INIT); //回传cmd给串口（7）
+  cmd_flush();
 }
 
 //8 关闭SPI -----------------------------------------
 void spi_cmd_deinit() {
   SPI.endTransaction();
   SPI.end();
+#if defined(MSPIM_AVAILABLE)
+  mspim_end();
+#endif
+  spi_bus = SPI_BUS_HW;
   pinMode(ISP_RST, INPUT);
+  CsPin1::release();            //其他CS引脚恢复为高阻输入（关闭上拉）
+  CsPin2::release();
+  CsPin3::release();
   
-  Serial.write(FUNC_SPI_DEINIT); //回传cmd给串口（8）
-  Serial.flush();
+  link_write(FUNC_SPI_DEINIT); //回传cmd给串口（8）
+  cmd_flush();
 }
 
 //9  spi拉低CE引脚 -----------------------------------------
 void spi_cmd_ce()
 {
-  digitalWrite(ISP_RST, LOW);     //拉低CS引脚
-  Serial.write(FUNC_SPI_CE); //回传命令码
-  Serial.flush();
+  cs_low(cs_mask);     //拉低CS引脚
+  link_write(FUNC_SPI_CE); //回传命令码
+  cmd_flush();
 }
 
 //10  spi释放CE引脚 -----------------------------------------
 void spi_cmd_dece()
 {
-  digitalWrite(ISP_RST, HIGH);     //拉低CS引脚
-  Serial.write(FUNC_SPI_DECE); //回传命令码
-  Serial.flush();
+  cs_high(cs_mask);    //释放CS引脚
+  link_write(FUNC_SPI_DECE); //回传命令码
+  cmd_flush();
 }
 
 //11  spi读命令 -----------------------------------------
 void spi_cmd_read() {
   byte bytesread;
 
-  bytesread = Serial.readBytes(buff, 1);  //从串口取1个字节
+  bytesread = link_read(buff, 1);  //从串口取1个字节
 
   if (bytesread == 0)
   {
-    Serial.write(ERROR_TIMOUT);
-    Serial.flush();
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
     return;
   }
   
   if (buff[0] > buffSize) {
-    Serial.write(ERROR_RECV);
-    Serial.flush();
+    link_write(ERROR_RECV);
+    cmd_flush();
     return;
   }
   bytesread = buff[0];            //要读的数据长度
 
-  Serial.write(FUNC_SPI_READ); //回传命令码
-  Serial.flush();
+  link_write(FUNC_SPI_READ); //回传命令码
+  cmd_flush();
 
-  SPI.transfer(buff, bytesread);     //SPI交换数据（buff写入并保存读取的字节）
-  Serial.write(buff, bytesread);   //上传读取的数据
-  Serial.flush();         //刷新缓冲区
+  cs_read_only();                    //群烧模式下只读取最低位一片
+  spi_read_buf(buff, bytesread);     //SPI读取数据（MOSI输出0xFF）
+  link_write(buff, bytesread);   //上传读取的数据
+  cmd_flush();         //刷新缓冲区
 
-  Serial.write(FUNC_SPI_READ); //回传命令码
-  Serial.flush();
+  link_write(FUNC_SPI_READ); //回传命令码
+  cmd_flush();
 }
 
 //12  spi写命令 -----------------------------------------
@@ -128,35 +178,35 @@ void spi_cmd_write() {
   byte byteswrite;
   byte bytesread;
   
-  byteswrite = Serial.readBytes(buff, 1);  //从串口取1个字节
+  byteswrite = link_read(buff, 1);  //从串口取1个字节
 
   if (byteswrite == 0)
   {
-    Serial.write(ERROR_TIMOUT);
-    Serial.flush();
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
     return;
   }
   
   if (buff[0] > buffSize) {
-    Serial.write(ERROR_RECV);
-    Serial.flush();
+    link_write(ERROR_RECV);
+    cmd_flush();
     return;
   }
   byteswrite = buff[0];            //要写的数据长度
 
-  Serial.write(FUNC_SPI_WRITE); //回传命令码
-  Serial.flush();
+  link_write(FUNC_SPI_WRITE); //回传命令码
+  cmd_flush();
 
-  bytesread = Serial.readBytes(buff, byteswrite); //从串口读取要写入的数据
+  bytesread = link_read(buff, byteswrite); //从串口读取要写入的数据
   if (byteswrite != bytesread) {
-    Serial.write(ERROR_RECV);
-    Serial.flush();
+    link_write(ERROR_RECV);
+    cmd_flush();
     return;
   }
 
-  SPI.transfer(buff, byteswrite);                 //SPI写入
-  Serial.write(FUNC_SPI_WRITE); //回传命令码
-  Serial.flush();
+  spi_write_buf(buff, byteswrite);                //SPI写入
+  link_write(FUNC_SPI_WRITE); //回传命令码
+  cmd_flush();
 }
 
 //13  测试命令，用于连通性测试，也可用于波特率识别
@@ -164,17 +214,978 @@ void spi_cmd_tst()
 {
   byte bytesread;
 
-  Serial.write(0xa5);
-  Serial.write(0x5a);
-  Serial.flush();         //发送两个识别码
+  link_write(0xa5);
+  link_write(0x5a);
+  cmd_flush();         //发送两个识别码
 
-  bytesread = Serial.readBytes(buff, 2);  //接收两个识别码
+  bytesread = link_read(buff, 2);  //接收两个识别码
   if (bytesread != 2 || buff[0] != 0xa5 || buff[1] != 0x5a) {
-    Serial.write(ERROR_RECV);
-    Serial.flush();
+    link_write(ERROR_RECV);
+    cmd_flush();
     return;
   }
   
-  Serial.write(FUNC_SPI_TST); //回传命令码
-  Serial.flush();
+  link_write(FUNC_SPI_TST); //回传命令码
+  cmd_flush();
+}
+
+//按大端序（高字节在前）取出32位数
+static uint32_t get_u32(byte *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+//按大端序取出3或4字节的地址
+static uint32_t get_addr(byte *p, byte addr_len)
+{
+  uint32_t addr = 0;
+  for (byte i = 0; i < addr_len; i++)
+    addr = (addr << 8) | p[i];
+  return addr;
+}
+
+//发送3或4字节的地址（高字节在前）
+static void spi_send_addr(uint32_t addr, byte addr_len)
+{
+  if (addr_len == 4)
+    spi_byte((byte)(addr >> 24));
+  spi_byte((byte)(addr >> 16));
+  spi_byte((byte)(addr >> 8));
+  spi_byte((byte)addr);
+}
+
+#define READ_FLAG_RLE 0x80        //空字节数的最高位：连续读使用压缩流
+
+//接收区间读类命令的参数：操作码(1) 地址长度(1, 3或4) 空字节数(1, 高4位为选项) 地址(3/4) 长度(4)
+//出错时回传错误码并返回非0
+static byte spi_recv_range(byte *opcode, byte *addr_len, byte *dummy, uint32_t *addr, uint32_t *len, byte *flags = NULL)
+{
+  byte bytesread;
+
+  bytesread = link_read(buff, 3);  //操作码、地址长度、空字节数
+  if (bytesread != 3)
+  {
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
+    return 1;
+  }
+
+  *opcode = buff[0];
+  *addr_len = buff[1];
+  *dummy = buff[2] & 0x0f;
+  if (flags)
+    *flags = buff[2] & 0xf0;
+  if ((*addr_len != 3 && *addr_len != 4) || *dummy > 4) {
+    link_write(ERROR_RECV);
+    cmd_flush();
+    return 1;
+  }
+
+  bytesread = link_read(buff, *addr_len + 4);  //地址与长度
+  if (bytesread != *addr_len + 4)
+  {
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
+    return 1;
+  }
+  *addr = get_addr(buff, *addr_len);
+  *len = get_u32(buff + *addr_len);
+  return 0;
+}
+
+//拉低cs并发送读命令头（操作码、地址、空字节），之后可连续读出数据
+static void spi_start_read(byte cs, byte opcode, uint32_t addr, byte addr_len, byte dummy)
+{
+  cs_low(cs);
+  spi_byte(opcode);
+  spi_send_addr(addr, addr_len);
+  while (dummy--)
+    spi_byte(0xff);
+}
+
+//整块是否为同一字节（此时重复段比重复块更省）
+static bool is_uniform(const byte *data, byte len)
+{
+  for (byte i = 1; i < len; i++)
+    if (data[i] != data[0])
+      return false;
+  return true;
+}
+
+static byte prev_block[RLE_BLOCK];      //压缩模式下的上一块数据
+
+static byte spi_job_yield(byte cs);     //见后台任务
+
+//14  spi连续读命令，CS只拉低一次，数据连续上传，直到读完整个区间 -----------------------------------------
+//参数：操作码(1) 地址长度(1, 3或4) 空字节数(1, 如0x0B快速读需1个，最高位置1时数据以压缩流上传，格式见rle.h) 地址(3/4) 长度(4)
+//帧模式下每块数据（buffSize字节）为一帧，序号从0开始，不压缩
+void spi_cmd_read_bulk() {
+  byte opcode;
+  byte addr_len;
+  byte dummy;
+  byte flags;
+  uint32_t addr;
+  uint32_t len;
+  byte n;
+  byte chunk;
+  byte seq = 0;
+  bool have_prev = false;
+
+  if (spi_recv_range(&opcode, &addr_len, &dummy, &addr, &len, &flags))
+    return;
+  if (frame_mode)
+    flags &= ~READ_FLAG_RLE;    //帧模式下不压缩
+  chunk = (flags & READ_FLAG_RLE) ? RLE_BLOCK : buffSize;     //压缩模式按块比较，每次读取一块
+
+  link_write(FUNC_SPI_READ_BULK); //回传命令码，之后开始连续上传数据
+  cmd_flush();
+
+  spi_start_read(cs_first(), opcode, addr, addr_len, dummy);     //拉低CS引脚，整个区间只操作一次
+  rle_begin();
+
+  while (len > 0)
+  {
+    if (spi_job_yield(cs_first()))
+      spi_start_read(cs_first(), opcode, addr, addr_len, dummy);  //轮询后台任务时释放了CS，从当前地址继续
+    n = len > chunk ? chunk : len;
+    spi_read_buf(buff, n);      //SPI读取一块
+    addr += n;
+    len -= n;
+
+    if (frame_mode) {
+      frame_send(seq++, buff, n); //帧模式，上位机校验出错时按序号重读对应区间
+    }
+    else if (!(flags & READ_FLAG_RLE)) {
+      link_write(buff, n);      //直接写入发送缓冲区，不等待发送完成，串口满时自然阻塞
+    }
+    else if (have_prev && n == RLE_BLOCK && memcmp(buff, prev_block, RLE_BLOCK) == 0 && !is_uniform(buff, n)) {
+      rle_repeat_block();         //与上一块相同
+    }
+    else {
+      if (n == RLE_BLOCK) {
+        memcpy(prev_block, buff, RLE_BLOCK);
+        have_prev = true;
+      }
+      else
+        have_prev = false;
+      rle_put(buff, n);
+    }
+  }
+  cs_high(cs_mask);    //释放CS引脚
+
+  if (flags & READ_FLAG_RLE)
+    rle_end();
+
+  cmd_flush();
+  link_write(FUNC_SPI_READ_BULK); //尾部状态
+  cmd_flush();
+}
+
+//轮询状态寄存器，等待WIP位清零，返回0成功，非0超时
+//progress非0时每隔SPI_PROGRESS_MS回传一个STATUS_BUSY
+static byte spi_wait_busy(unsigned long timeout_ms, byte progress)
+{
+  unsigned long start = millis();
+  unsigned long last = start;
+  byte status = 0;
+  byte cs;
+
+  for (cs = 0x01; cs & 0x0f; cs <<= 1)      //多片时逐片等待
+  {
+    if (!(cs_mask & cs))
+      continue;
+
+    cs_low(cs);
+    spi_byte(0x05);             //读状态寄存器1，CS保持拉低时可连续读出
+    do {
+      status = spi_byte(0xff);
+      if (!(status & 0x01))
+        break;
+      if (progress && millis() - last >= SPI_PROGRESS_MS) {
+        last += SPI_PROGRESS_MS;
+        link_write(STATUS_BUSY);  //进度字节，不等待发送完成
+      }
+    } while (millis() - start < timeout_ms);
+    cs_high(cs);
+
+    if (status & 0x01)
+      break;
+  }
+
+  return status & 0x01;
+}
+
+//发送写使能
+static void spi_write_enable()
+{
+  cs_low(cs_mask);
+  spi_byte(0x06);
+  cs_high(cs_mask);
+}
+
+static byte page_buff[SPI_PAGE_SIZE];     //页编程缓冲区
+
+//15  spi区间编程命令，按页边界拆分，每页自动写使能、页编程并等待完成 -----------------------------------------
+//参数：页编程操作码(1, 一般0x02) 地址长度(1, 3或4) 地址(3/4) 长度(4)
+//流程：回传命令码后，上位机按页边界拆分发送数据（首段为地址到页尾，之后每段一页，末段为剩余部分），
+//      每段开始编程后即回传一次命令码，上位机收到后发送下一段，下一段的接收与本段的编程同时进行，
+//      最后一段编程完成后才回传命令码
+//      帧模式下每段为一帧，序号从0开始，校验错误时回传STATUS_NAK和序号，上位机重发该段
+void spi_cmd_program() {
+  byte bytesread;
+  byte seq = 0;
+  byte busy = 0;
+  byte opcode;
+  byte addr_len;
+  uint32_t addr;
+  uint32_t len;
+  uint16_t n;
+
+  bytesread = link_read(buff, 2);  //操作码、地址长度
+  if (bytesread != 2)
+  {
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
+    return;
+  }
+
+  opcode = buff[0];
+  addr_len = buff[1];
+  if (addr_len != 3 && addr_len != 4) {
+    link_write(ERROR_RECV);
+    cmd_flush();
+    return;
+  }
+
+  bytesread = link_read(buff, addr_len + 4);  //地址与长度
+  if (bytesread != addr_len + 4)
+  {
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
+    return;
+  }
+  addr = get_addr(buff, addr_len);
+  len = get_u32(buff + addr_len);
+
+  link_write(FUNC_SPI_PROGRAM); //回传命令码，上位机开始发送第一段
+  cmd_flush();
+
+  while (len > 0)
+  {
+    spi_job_yield(0);           //段之间CS未拉低，可直接推进后台任务
+    n = SPI_PAGE_SIZE - (addr % SPI_PAGE_SIZE);     //本页剩余空间
+    if (n > len)
+      n = len;
+
+    if (frame_mode ? frame_recv(seq, page_buff, n, FUNC_SPI_PROGRAM) : link_read(page_buff, n) != n) {      //接收本段数据
+      link_write(ERROR_TIMOUT);
+      cmd_flush();
+      return;
+    }
+    seq++;
+
+    if (busy && spi_wait_busy(SPI_PP_TIMEOUT, 0)) {   //等待上一段编程完成（本段接收期间Flash已在编程）
+      link_write(ERROR_OPERAT);   //编程超时
+      cmd_flush();
+      return;
+    }
+
+    spi_write_enable();
+    cs_low(cs_mask);
+    spi_byte(opcode);
+    spi_send_addr(addr, addr_len);
+    spi_write_buf(page_buff, n);    //页编程，数据已进入Flash的页缓冲，page_buff可立即接收下一段
+    cs_high(cs_mask);
+    busy = 1;
+
+    addr += n;
+    len -= n;
+    if (len == 0 && spi_wait_busy(SPI_PP_TIMEOUT, 0)) {   //最后一段需等待完成后再应答
+      link_write(ERROR_OPERAT);   //编程超时
+      cmd_flush();
+      return;
+    }
+
+    link_write(FUNC_SPI_PROGRAM); //本段已开始编程，上位机可发送下一段
+    cmd_flush();
+  }
+}
+
+#define ERASE_4K      0
+#define ERASE_32K     1
+#define ERASE_64K     2
+#define ERASE_CHIP    3
+#define ERASE_RANGE   4
+#define ERASE_FLAG_BG 0x80        //后台擦除
+
+//发出一个单元的擦除命令（写使能、擦除命令），不等待完成
+static void spi_erase_start(byte type, uint32_t addr, byte addr_len)
+{
+  spi_write_enable();
+  cs_low(cs_mask);
+  switch (type)
+  {
+    case ERASE_4K:
+      spi_byte(0x20);
+      spi_send_addr(addr, addr_len);
+      break;
+    case ERASE_32K:
+      spi_byte(0x52);
+      spi_send_addr(addr, addr_len);
+      break;
+    case ERASE_64K:
+      spi_byte(0xd8);
+      spi_send_addr(addr, addr_len);
+      break;
+    default:
+      spi_byte(0xc7);
+  }
+  cs_high(cs_mask);
+}
+
+//单元擦除的最长等待时间 ms
+static unsigned long spi_erase_timeout(byte type)
+{
+  return type == ERASE_CHIP ? SPI_CE_TIMEOUT : (type == ERASE_4K ? SPI_SE_TIMEOUT : SPI_BE_TIMEOUT);
+}
+
+//区间擦除时选择下一个单元：地址对齐且剩余长度足够时使用最大的单元
+static byte spi_erase_pick(uint32_t addr, uint32_t len, uint32_t *size)
+{
+  if ((addr & 0xffff) == 0 && len >= 0x10000) {
+    *size = 0x10000;
+    return ERASE_64K;
+  }
+  if ((addr & 0x7fff) == 0 && len >= 0x8000) {
+    *size = 0x8000;
+    return ERASE_32K;
+  }
+  *size = 0x1000;
+  return ERASE_4K;
+}
+
+//擦除一个单元（写使能、擦除命令、等待完成），返回0成功，非0超时
+static byte spi_erase_unit(byte type, uint32_t addr, byte addr_len)
+{
+  spi_erase_start(type, addr, addr_len);
+  if (spi_wait_busy(spi_erase_timeout(type), 1))
+    return 1;
+
+  link_write(type);       //单元擦除完成，回传擦除类型作为进度
+  return 0;
+}
+
+/*
+  后台任务：擦除命令带ERASE_FLAG_BG时只发出第一个单元的擦除命令即应答，之后由loop()调用spi_job_poll
+  轮询状态寄存器，完成后自动发出区间中的下一个单元。轮询在命令之间和接收命令参数期间进行，期间可以处理其他命令，
+  如读取另一片芯片（其他片选或另一路总线）；连续读、编程、CRC32、查空、扇区CRC执行期间由spi_job_yield
+  每隔SPI_JOB_POLL_MS推进一次。访问正在擦除的芯片的命令先等待后台任务完成（见spi_job_sync）。
+  上位机用FUNC_SPI_JOB查询状态。
+*/
+#define JOB_IDLE    0
+#define JOB_BUSY    1
+#define JOB_DONE    2
+#define JOB_FAIL    3
+
+static byte job_state = JOB_IDLE;
+static byte job_bus;              //任务所在的总线和片选
+static byte job_mask;
+static byte job_type;             //擦除类型（区间或单个单元）
+static byte job_unit;             //当前单元的类型
+static byte job_addr_len;
+static uint32_t job_addr;         //当前单元地址
+static uint32_t job_len;          //区间擦除剩余长度（含当前单元）
+static uint32_t job_size;         //当前单元大小
+static unsigned long job_start;   //当前单元开始时间
+static unsigned long job_polled;  //长命令中上次轮询的时间
+
+//发出当前单元的擦除命令，调用前cs_mask、spi_bus需为任务的片选和总线
+static void spi_job_issue()
+{
+  if (job_type == ERASE_RANGE)
+    job_unit = spi_erase_pick(job_addr, job_len, &job_size);
+  else
+    job_unit = job_type;
+  spi_erase_start(job_unit, job_addr, job_addr_len);
+  job_start = millis();
+}
+
+//读取任务芯片的状态，完成时发出下一个单元
+static void spi_job_check()
+{
+  byte old_bus;
+  byte old_mask;
+  byte busy = 0;
+  byte cs;
+
+  if (job_state != JOB_BUSY)
+    return;
+
+  old_bus = spi_bus;
+  old_mask = cs_mask;
+  spi_bus = job_bus;
+  cs_mask = job_mask;
+
+  for (cs = 0x01; cs & 0x0f; cs <<= 1)
+  {
+    if (!(job_mask & cs))
+      continue;
+    cs_low(cs);
+    spi_byte(0x05);
+    busy |= spi_byte(0xff) & 0x01;
+    cs_high(cs);
+  }
+
+  if (!busy) {
+    if (job_type == ERASE_RANGE && job_len > job_size) {
+      job_addr += job_size;
+      job_len -= job_size;
+      spi_job_issue();
+    } else {
+      job_state = JOB_DONE;
+    }
+  }
+  else if (millis() - job_start >= spi_erase_timeout(job_unit)) {
+    job_state = JOB_FAIL;
+  }
+
+  spi_bus = old_bus;
+  cs_mask = old_mask;
+}
+
+//轮询后台任务，由loop()在命令之间调用
+void spi_job_poll()
+{
+  if (cs_held)
+    return;                       //上位机正在手动控制CS进行传输，轮询会插入时钟，等CS释放后再查
+  spi_job_check();
+}
+
+//长命令执行期间推进后台任务，每隔SPI_JOB_POLL_MS一次：先释放当前命令拉低的cs（0表示没有拉低）再轮询，
+//返回非0表示已轮询，连续读需从当前地址重新发送读命令头
+static byte spi_job_yield(byte cs)
+{
+  if (job_state != JOB_BUSY || millis() - job_polled < SPI_JOB_POLL_MS)
+    return 0;
+  job_polled = millis();
+  cs_high(cs);
+  spi_job_poll();
+  return 1;
+}
+
+//等待后台任务结束，等待期间每隔SPI_PROGRESS_MS回传一个STATUS_BUSY，避免上位机读超时
+static void spi_job_wait()
+{
+  unsigned long last = millis();
+
+  while (job_state == JOB_BUSY)
+  {
+    spi_job_check();
+    if (job_state == JOB_BUSY && millis() - last >= SPI_PROGRESS_MS) {
+      last += SPI_PROGRESS_MS;
+      link_write(STATUS_BUSY);  //进度字节，不等待发送完成
+    }
+  }
+}
+
+//命令会访问正在后台擦除的芯片（同一总线、片选有重叠）或关闭SPI时，先等待后台任务结束，由ParseCommand在执行命令前调用
+//等待期间回传STATUS_BUSY，之后才是命令本身的应答
+void spi_job_sync(char cmd)
+{
+  switch (cmd)
+  {
+    case FUNC_SPI_DEINIT:
+      break;
+
+    case FUNC_SPI_CE:
+    case FUNC_SPI_DECE:
+    case FUNC_SPI_READ:
+    case FUNC_SPI_WRITE:
+    case FUNC_SPI_READ_BULK:
+    case FUNC_SPI_PROGRAM:
+    case FUNC_SPI_ERASE:
+    case FUNC_SPI_CRC32:
+    case FUNC_SPI_BLANK:
+    case FUNC_SPI_SECTOR_CRC:
+    case FUNC_SPI_XFER:
+    case FUNC_SPI_WRITE_STREAM:
+      if (spi_bus != job_bus || !(cs_mask & job_mask))
+        return;
+      break;
+
+    default:
+      return;
+  }
+
+  spi_job_wait();
+}
+
+//16  spi擦除命令，设备端等待擦除完成并回传进度 -----------------------------------------
+//参数：类型(1, 0:4K 1:32K 2:64K 3:整片 4:区间，bit7为ERASE_FLAG_BG) 地址长度(1, 3或4) 地址(3/4) 长度(4, 仅区间擦除使用)
+//区间擦除要求地址和长度4K对齐，自动选择最大的对齐擦除单元
+//回传：命令码，之后擦除期间周期性回传STATUS_BUSY，每完成一个单元回传其类型，最后回传命令码
+//      后台擦除时只回传两次命令码，擦除在后台进行，结果由FUNC_SPI_JOB查询；
+//      上一个后台任务未结束或其结果尚未被FUNC_SPI_JOB读取时回传ERROR_OPERAT，不开始新任务
+void spi_cmd_erase() {
+  byte bytesread;
+  byte type;
+  byte bg;
+  byte unit_type;
+  uint32_t unit_size;
+  byte addr_len;
+  uint32_t addr;
+  uint32_t len;
+
+  bytesread = link_read(buff, 2);  //类型、地址长度
+  if (bytesread != 2)
+  {
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
+    return;
+  }
+
+  type = buff[0] & ~ERASE_FLAG_BG;
+  bg = buff[0] & ERASE_FLAG_BG;
+  addr_len = buff[1];
+  if (type > ERASE_RANGE || (addr_len != 3 && addr_len != 4)) {
+    link_write(ERROR_RECV);
+    cmd_flush();
+    return;
+  }
+
+  bytesread = link_read(buff, addr_len + 4);  //地址与长度
+  if (bytesread != addr_len + 4)
+  {
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
+    return;
+  }
+  addr = get_addr(buff, addr_len);
+  len = get_u32(buff + addr_len);
+
+  if (type == ERASE_RANGE && ((addr | len) & 0xfff)) {
+    link_write(ERROR_RECV);   //区间未按4K对齐
+    cmd_flush();
+    return;
+  }
+
+  if (bg && job_state != JOB_IDLE) {
+    link_write(ERROR_OPERAT);   //同时只有一个后台任务，且上一个任务的结果必须先被读取
+    cmd_flush();
+    return;
+  }
+
+  link_write(FUNC_SPI_ERASE); //回传命令码
+  cmd_flush();
+
+  if (bg) {
+    if (type == ERASE_RANGE && len == 0) {
+      job_state = JOB_DONE;
+    } else {
+      job_state = JOB_BUSY;
+      job_bus = spi_bus;
+      job_mask = cs_mask;
+      job_type = type;
+      job_addr_len = addr_len;
+      job_addr = addr;
+      job_len = len;
+      spi_job_issue();
+    }
+
+    link_write(FUNC_SPI_ERASE); //已开始擦除
+    cmd_flush();
+    return;
+  }
+
+  if (type != ERASE_RANGE) {
+    if (spi_erase_unit(type, addr, addr_len)) {
+      link_write(ERROR_OPERAT);   //擦除超时
+      cmd_flush();
+      return;
+    }
+  }
+
+  while (type == ERASE_RANGE && len > 0)
+  {
+    unit_type = spi_erase_pick(addr, len, &unit_size);
+    if (spi_erase_unit(unit_type, addr, addr_len)) {
+      link_write(ERROR_OPERAT);   //擦除超时
+      cmd_flush();
+      return;
+    }
+    addr += unit_size;
+    len -= unit_size;
+  }
+
+  link_write(FUNC_SPI_ERASE); //擦除完成
+  cmd_flush();
+}
+
+//17  spi区间CRC32命令，设备端读取区间并只回传CRC32 -----------------------------------------
+//参数：同连续读命令，操作码(1) 地址长度(1) 空字节数(1) 地址(3/4) 长度(4)
+//回传：命令码，计算期间周期性回传STATUS_BUSY，完成后回传命令码、CRC32(4字节，高字节在前)、命令码
+//      多片选时逐片计算，按片选顺序依次回传每片的CRC32
+void spi_cmd_crc32() {
+  byte opcode;
+  byte addr_len;
+  byte dummy;
+  uint32_t addr;
+  uint32_t len;
+  uint32_t left;
+  uint32_t crc[SPI_CS_COUNT];
+  unsigned long last;
+  byte n;
+  byte cs;
+  byte i;
+
+  if (spi_recv_range(&opcode, &addr_len, &dummy, &addr, &len))
+    return;
+
+  link_write(FUNC_SPI_CRC32); //回传命令码
+  cmd_flush();
+
+  last = millis();
+  for (cs = 0x01, i = 0; i < SPI_CS_COUNT; cs <<= 1, i++)
+  {
+    crc[i] = CRC32_INIT;
+    if (!(cs_mask & cs))
+      continue;
+
+    spi_start_read(cs, opcode, addr, addr_len, dummy);
+    for (left = len; left > 0; left -= n)
+    {
+      if (spi_job_yield(cs))
+        spi_start_read(cs, opcode, addr + (len - left), addr_len, dummy);
+      n = left > buffSize ? buffSize : left;
+      spi_read_buf(buff, n);
+      crc[i] = crc32_update(crc[i], buff, n);
+
+      if (millis() - last >= SPI_PROGRESS_MS) {
+        last += SPI_PROGRESS_MS;
+        link_write(STATUS_BUSY);  //进度字节，避免上位机超时
+      }
+    }
+    cs_high(cs);
+  }
+
+  link_write(FUNC_SPI_CRC32); //计算完成，其后为CRC32
+  for (cs = 0x01, i = 0; i < SPI_CS_COUNT; cs <<= 1, i++)
+  {
+    if (!(cs_mask & cs))
+      continue;
+    crc[i] = ~crc[i];
+    link_write((byte)(crc[i] >> 24));
+    link_write((byte)(crc[i] >> 16));
+    link_write((byte)(crc[i] >> 8));
+    link_write((byte)crc[i]);
+  }
+  link_write(FUNC_SPI_CRC32); //回传命令码
+  cmd_flush();
+}
+
+//18  spi查空命令，设备端检查区间是否全为0xFF -----------------------------------------
+//参数：同连续读命令，操作码(1) 地址长度(1) 空字节数(1) 地址(3/4) 长度(4)
+//回传：命令码，检查期间周期性回传STATUS_BUSY，完成后回传命令码、结果(1, 0为空 1为非空)、
+//      首个非空字节的地址(4字节，高字节在前，为空时是区间结束地址)、命令码
+void spi_cmd_blank() {
+  byte opcode;
+  byte addr_len;
+  byte dummy;
+  uint32_t addr;
+  uint32_t len;
+  unsigned long last;
+  byte blank = 1;
+  byte n;
+  byte i;
+
+  if (spi_recv_range(&opcode, &addr_len, &dummy, &addr, &len))
+    return;
+
+  link_write(FUNC_SPI_BLANK); //回传命令码
+  cmd_flush();
+
+  last = millis();
+  spi_start_read(cs_first(), opcode, addr, addr_len, dummy);
+  while (len > 0 && blank)
+  {
+    if (spi_job_yield(cs_first()))
+      spi_start_read(cs_first(), opcode, addr, addr_len, dummy);
+    n = len > buffSize ? buffSize : len;
+    spi_read_buf(buff, n);
+    for (i = 0; i < n; i++) {
+      if (buff[i] != 0xff) {
+        blank = 0;          //找到首个非空字节
+        break;
+      }
+    }
+    addr += i;
+    len -= i;
+
+    if (millis() - last >= SPI_PROGRESS_MS) {
+      last += SPI_PROGRESS_MS;
+      link_write(STATUS_BUSY);  //进度字节，避免上位机超时
+    }
+  }
+  cs_high(cs_mask);
+
+  link_write(FUNC_SPI_BLANK); //检查完成，其后为结果
+  link_write(blank ? 0 : 1);
+  link_write((byte)(addr >> 24));
+  link_write((byte)(addr >> 16));
+  link_write((byte)(addr >> 8));
+  link_write((byte)addr);
+  link_write(FUNC_SPI_BLANK); //回传命令码
+  cmd_flush();
+}
+
+//19  spi扇区CRC列表命令，按4K扇区分别计算CRC32，用于上位机差分烧录 -----------------------------------------
+//参数：同连续读命令，操作码(1) 地址长度(1) 空字节数(1) 地址(3/4) 长度(4)，地址和长度需按扇区对齐
+//回传：命令码，之后依次回传每个扇区的CRC32(4字节，高字节在前)，最后回传命令码
+void spi_cmd_sector_crc() {
+  byte opcode;
+  byte addr_len;
+  byte dummy;
+  uint32_t addr;
+  uint32_t len;
+  uint32_t crc;
+  uint16_t left;
+  byte n;
+
+  if (spi_recv_range(&opcode, &addr_len, &dummy, &addr, &len))
+    return;
+
+  if ((addr | len) & (SPI_SECTOR_SIZE - 1)) {
+    link_write(ERROR_RECV);   //区间未按扇区对齐
+    cmd_flush();
+    return;
+  }
+
+  link_write(FUNC_SPI_SECTOR_CRC); //回传命令码
+  cmd_flush();
+
+  spi_start_read(cs_first(), opcode, addr, addr_len, dummy);
+  while (len > 0)
+  {
+    crc = CRC32_INIT;
+    for (left = SPI_SECTOR_SIZE; left > 0; left -= n)
+    {
+      if (spi_job_yield(cs_first()))
+        spi_start_read(cs_first(), opcode, addr, addr_len, dummy);
+      n = left > buffSize ? buffSize : left;
+      spi_read_buf(buff, n);
+      crc = crc32_update(crc, buff, n);
+      addr += n;
+    }
+    len -= SPI_SECTOR_SIZE;
+
+    crc = ~crc;
+    link_write((byte)(crc >> 24));    //每个扇区完成即回传，不等待发送完成
+    link_write((byte)(crc >> 16));
+    link_write((byte)(crc >> 8));
+    link_write((byte)crc);
+  }
+  cs_high(cs_mask);
+
+  link_write(FUNC_SPI_SECTOR_CRC); //回传命令码
+  cmd_flush();
+}
+
+#define XFER_CS_BEGIN   0x01      //开始前拉低CS
+#define XFER_CS_END     0x02      //结束后释放CS
+
+//50  spi组合传输命令，一条命令完成 拉低CS+写+读+释放CS -----------------------------------------
+//参数：标志(1, bit0开始前拉低CS bit1结束后释放CS) 写长度(1) 读长度(1) 写数据，长度均不超过buffSize
+//上位机一次发送全部参数和数据，无需等待回传
+//多片选时写数据发给所有选中的芯片，读之前释放其他片，只读取最低位一片
+//回传：命令码、读出的数据；出错时只回传错误码
+void spi_cmd_xfer() {
+  byte bytesread;
+  byte flags;
+  byte wlen;
+  byte rlen;
+
+  bytesread = link_read(buff, 3);  //标志、写长度、读长度
+  if (bytesread != 3)
+  {
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
+    return;
+  }
+
+  flags = buff[0];
+  wlen = buff[1];
+  rlen = buff[2];
+  if (wlen > buffSize || rlen > buffSize) {
+    link_write(ERROR_RECV);
+    cmd_flush();
+    return;
+  }
+
+  bytesread = link_read(buff, wlen);   //要写入的数据
+  if (bytesread != wlen)
+  {
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
+    return;
+  }
+
+  if (flags & XFER_CS_BEGIN)
+    cs_low(cs_mask);
+  spi_write_buf(buff, wlen);        //写入广播到所有选中的芯片
+  if (rlen > 0) {
+    cs_read_only();                 //读取只选中最低位一片
+    spi_read_buf(buff, rlen);
+  }
+  if (flags & XFER_CS_END)
+    cs_high(cs_mask);
+
+  link_write(FUNC_SPI_XFER); //回传命令码
+  link_write(buff, rlen);    //上传读取的数据
+  cmd_flush();
+}
+
+//51  spi直通写命令，串口收到的每个字节直接写入SPDR，不经过缓冲区，长度不受buffSize限制 -----------------------------------------
+//参数：长度(4, 高字节在前)，CS由上位机通过FUNC_SPI_CE/FUNC_SPI_DECE控制
+//流程：回传命令码后，上位机连续发送全部数据（SPI远快于串口，无需分段等待），完成后回传命令码
+void spi_cmd_write_stream() {
+  byte bytesread;
+  uint32_t len;
+  unsigned long start;
+
+  bytesread = link_read(buff, 4);  //长度
+  if (bytesread != 4)
+  {
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
+    return;
+  }
+  len = get_u32(buff);
+
+  link_write(FUNC_SPI_WRITE_STREAM); //回传命令码
+  cmd_flush();
+
+  while (len > 0)
+  {
+    start = millis();
+    while (link_available() <= 0) {
+      if (millis() - start >= LINK_TIMEOUT) {
+        link_write(ERROR_TIMOUT);
+        cmd_flush();
+        return;
+      }
+    }
+
+    spi_byte(link_read_byte());        //直接送入SPI，等待发送完成（8MHz下约1us，远小于串口一个字节的时间）
+    len--;
+  }
+
+  link_write(FUNC_SPI_WRITE_STREAM); //回传命令码
+  cmd_flush();
+}
+
+//52  spi片选选择命令 -----------------------------------------
+//参数：选择掩码(1, bit0~bit3对应ISP_RST、ISP_CS1~ISP_CS3，不能为0)
+//多片同时选中时为群烧模式：写使能、编程、擦除等写操作同时发送给所有选中的芯片，
+//忙等待和CRC32逐片进行；连续读、查空、扇区CRC只读取选中的最低位一片
+void spi_cmd_cs_sel()
+{
+  byte bytesread;
+
+  bytesread = link_read(buff, 1);
+  if (bytesread != 1)
+  {
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
+    return;
+  }
+
+  if (buff[0] == 0 || buff[0] > 0x0f) {
+    link_write(ERROR_RECV);
+    cmd_flush();
+    return;
+  }
+
+  cs_high(cs_mask);                          //只释放原来选中的CS（只有它们配置为输出）
+  if (!(buff[0] & 0x02)) CsPin1::release();  //未选中的CS1~CS3恢复为高阻输入，不打开上拉
+  if (!(buff[0] & 0x04)) CsPin2::release();
+  if (!(buff[0] & 0x08)) CsPin3::release();
+  cs_mask = buff[0];
+  if (cs_mask & 0x02) { CsPin1::high(); CsPin1::output(); }   //选中的CS引脚配置为输出（先置高，避免输出低电平）
+  if (cs_mask & 0x04) { CsPin2::high(); CsPin2::output(); }
+  if (cs_mask & 0x08) { CsPin3::high(); CsPin3::output(); }
+
+  link_write(FUNC_SPI_CS_SEL); //回传命令码
+  cmd_flush();
+}
+
+//53  spi总线选择命令 -----------------------------------------
+//参数：总线(1, 0为硬件SPI，1为USART1 MSPIM)、分频(1, 2~128，仅总线1有效，总线0的速度由FUNC_SPI_INIT设置)
+//片选引脚两路总线共用，由FUNC_SPI_CS_SEL选择；切换总线后命令均作用于新总线
+//固件为单线程，两片芯片“同时”操作时上位机交替发送两路总线的命令（如一路等待擦除时另一路读取）
+void spi_cmd_bus()
+{
+  byte bytesread;
+
+  bytesread = link_read(buff, 2);
+  if (bytesread != 2)
+  {
+    link_write(ERROR_TIMOUT);
+    cmd_flush();
+    return;
+  }
+
+  if (buff[0] == SPI_BUS_HW) {
+    spi_bus = SPI_BUS_HW;
+    link_write(FUNC_SPI_BUS); //回传命令码
+    cmd_flush();
+    return;
+  }
+
+#if defined(MSPIM_AVAILABLE)
+  if (buff[0] == SPI_BUS_MSPIM) {
+    switch(buff[1])
+    {
+      case 2:
+      case 4:
+      case 8:
+      case 16:
+      case 32:
+      case 64:
+      case 128:
+        break;
+
+      default:
+        link_write(ERROR_RECV); //接收错误
+        cmd_flush();
+        return;
+    }
+
+    mspim_init(buff[1]);
+    spi_bus = SPI_BUS_MSPIM;
+    link_write(FUNC_SPI_BUS); //回传命令码
+    cmd_flush();
+    return;
+  }
+#endif
+
+  link_write(ERROR_OPERAT); //总线不存在（ATmega328P没有空闲的USART）
+  cmd_flush();
+}
+
+//54  spi后台任务状态查询 -----------------------------------------
+//回传：命令码、状态(1, 0:空闲 1:进行中 2:完成 3:超时)、当前单元地址(4, 高字节在前)、命令码
+//完成或超时的状态只回传一次，之后回到空闲
+void spi_cmd_job()
+{
+  link_write(FUNC_SPI_JOB); //回传命令码
+  link_write(job_state);
+  link_write((byte)(job_addr >> 24));
+  link_write((byte)(job_addr >> 16));
+  link_write((byte)(job_addr >> 8));
+  link_write((byte)job_addr);
+  link_write(FUNC_SPI_JOB); //回传命令码
+  cmd_flush();
+
+  if (job_state != JOB_BUSY)
+    job_state = JOB_IDLE;
 }
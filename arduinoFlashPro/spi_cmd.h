@@ -9,6 +9,19 @@ void spi_cmd_deinit();
 void spi_cmd_ce();
 void spi_cmd_dece();
 void spi_cmd_tst();
+void spi_cmd_read_bulk();
+void spi_cmd_program();
+void spi_cmd_erase();
+void spi_cmd_crc32();
+void spi_cmd_blank();
+void spi_cmd_sector_crc();
+void spi_cmd_xfer();
+void spi_cmd_write_stream();
+void spi_cmd_cs_sel();
+void spi_cmd_bus();
+void spi_cmd_job();
+void spi_job_poll();
+void spi_job_sync(char cmd);
 
 
 #endif
\ No newline at end of file
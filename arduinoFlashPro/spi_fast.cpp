@@ -0,0 +1,85 @@
+/*
+	该程序基于简易的arduino硬件，主要目的是烧录SPI Flash，如W25QXX等，主要原理是实现了UART转SPI的功能，需配合上位机使用。
+  也可烧录eepron，如24cxx
+  寄存器级SPI块传输
+    Copyright (C) 2023  LiHangBing
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+  F_CPU/2时每字节在总线上只需16个时钟周期，SPIF置位后应尽快写入下一字节：
+  下面的循环在SPIF置位后只执行 读SPDR、写SPDR 两条指令就启动下一字节，
+  保存数据、移动指针、计数等操作都放在下一字节传输的16个周期内完成
+*/
+
+#include <arduino.h>
+#include "spi_fast.h"
+
+byte spi_bus = SPI_BUS_HW;
+
+//读取len字节，MOSI固定输出0xFF，不需要预先填充缓冲区
+void spi_read_buf(byte *buf, uint16_t len)
+{
+  byte in;
+
+#if defined(MSPIM_AVAILABLE)
+  if (spi_bus == SPI_BUS_MSPIM) {
+    mspim_read_buf(buf, len);
+    return;
+  }
+#endif
+  if (len == 0)
+    return;
+
+  SPDR = 0xff;
+  while (--len)
+  {
+    while (!(SPSR & _BV(SPIF)))
+      ;
+    in = SPDR;
+    SPDR = 0xff;            //立即启动下一字节
+    *buf++ = in;            //在传输期间保存
+  }
+  while (!(SPSR & _BV(SPIF)))
+    ;
+  *buf = SPDR;
+}
+
+//写入len字节，丢弃读回的数据
+void spi_write_buf(const byte *buf, uint16_t len)
+{
+  byte out;
+
+#if defined(MSPIM_AVAILABLE)
+  if (spi_bus == SPI_BUS_MSPIM) {
+    mspim_write_buf(buf, len);
+    return;
+  }
+#endif
+  if (len == 0)
+    return;
+
+  SPDR = *buf++;
+  while (--len)
+  {
+    out = *buf++;           //在传输期间取下一字节
+    while (!(SPSR & _BV(SPIF)))
+      ;
+    SPDR = out;
+  }
+  while (!(SPSR & _BV(SPIF)))
+    ;
+  (void)SPDR;               //清除SPIF
+}
@@ -0,0 +1,29 @@
+#ifndef SPI_FAST_H
+#define SPI_FAST_H
+
+#include <arduino.h>
+#include "mspim.h"
+
+//当前使用的SPI总线：0为硬件SPI，1为USART1 MSPIM（见mspim.h）
+#define SPI_BUS_HW    0
+#define SPI_BUS_MSPIM 1
+extern byte spi_bus;
+
+void spi_read_buf(byte *buf, uint16_t len);
+void spi_write_buf(const byte *buf, uint16_t len);
+
+//在当前总线上交换一个字节
+static inline byte spi_byte(byte data)
+{
+#if defined(MSPIM_AVAILABLE)
+  if (spi_bus == SPI_BUS_MSPIM)
+    return mspim_transfer(data);
+#endif
+  SPDR = data;
+  while (!(SPSR & _BV(SPIF)))
+    ;
+  return SPDR;
+}
+
+
+#endif
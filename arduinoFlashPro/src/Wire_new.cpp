@@ -25,7 +25,6 @@ extern "C" {
   #include <stdlib.h>
   #include <string.h>
   #include <inttypes.h>
-  #include <util/delay.h>
   #include <compat/twi.h>			//添加寄存器定义
   #include "twi/twi.h"
 }
@@ -48,9 +47,21 @@ void (*TwoWire_new::user_onRequest)(void);
 void (*TwoWire_new::user_onReceive)(int);
 
 uint32_t I2c_clock = TWI_FREQ;				//I2C时钟频率，默认100K
-const uint8_t us_per_loop = 8;	//用于循环延时
 #define waitT  50							//最大等待周期（8bit+ack共9个周期，需向上取整）
+#define loop_cycles  8						//twi_wait每次循环的CPU周期数（lds、sbrc、sbiw、brne），用于把超时换算为循环次数
 uint16_t twi_timeout_us = (waitT*1000000 + I2c_clock - 1)/I2c_clock;
+uint16_t twi_timeout_loops = (uint32_t)twi_timeout_us * (F_CPU / 1000000) / loop_cycles;	//10K时为10000，不会溢出
+
+//直接在TWINT上自旋，置位后下一个循环即可发现；超时按CPU周期计数，不调用延时函数，返回0成功，非0超时
+static inline uint8_t twi_wait()
+{
+	uint16_t counter = twi_timeout_loops;
+	while(!(TWCR & _BV(TWINT))){
+		if (--counter == 0)
+			return 1;
+	}
+	return 0;
+}
 
 
 
@@ -97,6 +108,7 @@ void TwoWire_new::setClock(uint32_t clock)
   twi_setFrequency(clock);
   I2c_clock = clock;
   twi_timeout_us = (waitT*1000000 + I2c_clock - 1)/I2c_clock;
+  twi_timeout_loops = (uint32_t)twi_timeout_us * (F_CPU / 1000000) / loop_cycles;
 }
 
 /***
@@ -153,15 +165,8 @@ uint8_t TwoWire_new::sendStart()			//发送起始信号
 	
 	// send start condition
     TWCR = _BV(TWEN)  | _BV(TWEA) | _BV(TWINT) | _BV(TWSTA);		//使能TWI、清除中断标志、发送起始信号
-	uint16_t counter = (twi_timeout_us + us_per_loop - 1)/us_per_loop; // Round up
-	while(!(TWCR & _BV(TWINT))){		//Wait for TWINT Flag set. This indicates that the START condition has been transmitted.
-	  if (counter > 0ul){
-		_delay_us(us_per_loop);
-		counter--;
-	  } else {
+	if(twi_wait())				//Wait for TWINT Flag set.
 		return 0xff;
-	  }
-	}
 	
 	if( TW_STATUS != TW_START && TW_STATUS != TW_REP_START)
 		return 0xfe;
@@ -191,15 +196,8 @@ uint8_t TwoWire_new::readData(uint8_t *data, size_t quantity, uint8_t nack_last)
 		else
 			TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);				//清除中断标志，使能ACK，启动接收
 		
-		uint32_t counter = (twi_timeout_us + us_per_loop - 1)/us_per_loop; // Round up
-		while(!(TWCR & _BV(TWINT))){		//Wait for TWINT Flag set.
-		  if (counter > 0ul){
-			_delay_us(us_per_loop);
-			counter--;
-		  } else {
+		if(twi_wait())				//Wait for TWINT Flag set.
 			return 0xfe;
-		  }
-		}
 		
 		if(TW_STATUS == TW_MR_DATA_ACK || TW_STATUS == TW_MR_DATA_NACK)	//接收完数据并ack/nack
 			data[i] = TWDR;
@@ -216,14 +214,8 @@ uint8_t TwoWire_new::writeData(uint8_t *data, size_t quantity)						//写入数
 	{
 		TWDR = data[i];				//发数据
 		TWCR = _BV(TWEN)  | _BV(TWEA) | _BV(TWINT);		//使能TWI、使能ACK、清除中断标志，清中断标志则立即发送数据
-		uint32_t counter = (twi_timeout_us + us_per_loop - 1)/us_per_loop; // Round up
-		while(!(TWCR & _BV(TWINT))){		//Wait for TWINT Flag set.
-		  if (counter > 0ul){
-			_delay_us(us_per_loop);
-			counter--;
-		  } else
-				return 0xff;
-		}
+		if(twi_wait())				//Wait for TWINT Flag set.
+			return 0xff;
 		
 		if( TW_STATUS != TW_MT_SLA_ACK && TW_STATUS != TW_MT_DATA_ACK && TW_STATUS != TW_MR_SLA_ACK)	//每次发送完都要检查ack（发送地址读/写 ACK，发送数据收到ACK，共三种）
 			return 0xfe;
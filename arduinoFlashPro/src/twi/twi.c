@@ -61,6 +61,9 @@ static void (*twi_onSlaveReceive)(uint8_t*, int);
 static uint8_t twi_masterBuffer[TWI_BUFFER_LENGTH];
 static volatile uint8_t twi_masterBufferIndex;
 static volatile uint8_t twi_masterBufferLength;
+static uint8_t* volatile twi_masterData = twi_masterBuffer;	// 主机发送的数据，异步写时直接指向调用者的缓冲区
+static volatile uint8_t twi_async;				// 当前为twi_writeToAsync发起的传输，结束时调用twi_onMasterDone
+static void (*twi_onMasterDone)(uint8_t);
 
 static uint8_t twi_txBuffer[TWI_BUFFER_LENGTH];
 static volatile uint8_t twi_txBufferIndex;
@@ -175,10 +178,12 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length, uint8_t sen
   }
   twi_state = TWI_MRX;
   twi_sendStop = sendStop;
+  twi_async = false;
   // reset error state (0xFF.. no error occurred)
   twi_error = 0xFF;
 
   // initialize buffer iteration vars
+  twi_masterData = twi_masterBuffer;
   twi_masterBufferIndex = 0;
   twi_masterBufferLength = length-1;  // This is not intuitive, read on...
   // On receive, the previously configured ACK/NACK setting is transmitted in
@@ -269,10 +274,12 @@ uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait
   }
   twi_state = TWI_MTX;
   twi_sendStop = sendStop;
+  twi_async = false;
   // reset error state (0xFF.. no error occurred)
   twi_error = 0xFF;
 
   // initialize buffer iteration vars
+  twi_masterData = twi_masterBuffer;
   twi_masterBufferIndex = 0;
   twi_masterBufferLength = length;
   
@@ -329,6 +336,74 @@ uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait
     return 4;	// other twi error
 }
 
+/* 
+ * Function twi_writeToAsync
+ * Desc     starts an interrupt driven write of a series of bytes to a device
+ *          on the bus, ending with a stop, and returns immediately.
+ *          data is not copied and must stay valid until the transfer ends;
+ *          the master done callback is called from the ISR with the result
+ * Input    address: 7bit i2c device address
+ *          data: pointer to byte array
+ *          length: number of bytes in array (0 only checks for an address ack)
+ * Output   0 .. started
+ *          1 .. twi busy
+ */
+uint8_t twi_writeToAsync(uint8_t address, uint8_t* data, uint8_t length)
+{
+  if(TWI_READY != twi_state){
+    return 1;
+  }
+  twi_state = TWI_MTX;
+  twi_sendStop = true;
+  twi_async = true;
+  twi_error = 0xFF;
+
+  twi_masterData = data;
+  twi_masterBufferIndex = 0;
+  twi_masterBufferLength = length;
+
+  twi_slarw = TW_WRITE;
+  twi_slarw |= address << 1;
+
+  // send start condition
+  TWCR = _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE) | _BV(TWSTA);	// enable INTs
+  return 0;
+}
+
+/* 
+ * Function twi_readFromAsync
+ * Desc     starts an interrupt driven read of a series of bytes from a device
+ *          on the bus, the last byte is nacked and followed by a stop, and
+ *          returns immediately. data must stay valid until the transfer ends;
+ *          the master done callback is called from the ISR with the result
+ * Input    address: 7bit i2c device address
+ *          data: pointer to byte array
+ *          length: number of bytes to read (at least 1)
+ * Output   0 .. started
+ *          1 .. twi busy or length is 0
+ */
+uint8_t twi_readFromAsync(uint8_t address, uint8_t* data, uint8_t length)
+{
+  if(TWI_READY != twi_state || 0 == length){
+    return 1;
+  }
+  twi_state = TWI_MRX;
+  twi_sendStop = true;
+  twi_async = true;
+  twi_error = 0xFF;
+
+  twi_masterData = data;
+  twi_masterBufferIndex = 0;
+  twi_masterBufferLength = length-1;  // nack is set up when the next to last byte is received, see twi_readFrom
+
+  twi_slarw = TW_READ;
+  twi_slarw |= address << 1;
+
+  // send start condition
+  TWCR = _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE) | _BV(TWSTA);	// enable INTs
+  return 0;
+}
+
 /* 
  * Function twi_transmit
  * Desc     fills slave tx buffer with data
@@ -384,6 +459,47 @@ void twi_attachSlaveTxEvent( void (*function)(void) )
   twi_onSlaveTransmit = function;
 }
 
+/* 
+ * Function twi_attachMasterDoneEvent
+ * Desc     sets function called from the ISR when a twi_writeToAsync or
+ *          twi_readFromAsync transfer ends
+ * Input    function: callback function, argument is the result as for twi_writeTo
+ *          (0 .. success, 2 .. address nack, 3 .. data nack, 4 .. other error)
+ * Output   none
+ */
+void twi_attachMasterDoneEvent( void (*function)(uint8_t) )
+{
+  twi_onMasterDone = function;
+}
+
+/* 
+ * Function twi_masterDone
+ * Desc     reports the end of an asynchronous master transfer, called from the ISR
+ *          after the bus has been released so the callback may start the next one
+ * Input    none
+ * Output   none
+ */
+static void twi_masterDone(void)
+{
+  uint8_t result;
+
+  if (!twi_async)
+    return;
+  twi_async = false;
+
+  if (twi_error == 0xFF)
+    result = 0;
+  else if (twi_error == TW_MT_SLA_NACK || twi_error == TW_MR_SLA_NACK)
+    result = 2;
+  else if (twi_error == TW_MT_DATA_NACK)
+    result = 3;
+  else
+    result = 4;
+
+  if (twi_onMasterDone)
+    twi_onMasterDone(result);
+}
+
 /* 
  * Function twi_reply
  * Desc     sends byte or readys receive line
@@ -517,11 +633,12 @@ ISR(TWI_vect)
       // if there is data to send, send it, otherwise stop 
       if(twi_masterBufferIndex < twi_masterBufferLength){
         // copy data to output register and ack
-        TWDR = twi_masterBuffer[twi_masterBufferIndex++];
+        TWDR = twi_masterData[twi_masterBufferIndex++];
         twi_reply(1);
       }else{
         if (twi_sendStop){
           twi_stop();
+          twi_masterDone();
        } else {
          twi_inRepStart = true;	// we're gonna send the START
          // don't enable the interrupt. We'll generate the start, but we
@@ -535,20 +652,23 @@ ISR(TWI_vect)
     case TW_MT_SLA_NACK:  // address sent, nack received
       twi_error = TW_MT_SLA_NACK;
       twi_stop();
+      twi_masterDone();
       break;
     case TW_MT_DATA_NACK: // data sent, nack received
       twi_error = TW_MT_DATA_NACK;
       twi_stop();
+      twi_masterDone();
       break;
     case TW_MT_ARB_LOST: // lost bus arbitration
       twi_error = TW_MT_ARB_LOST;
       twi_releaseBus();
+      twi_masterDone();
       break;
 
     // Master Receiver
     case TW_MR_DATA_ACK: // data received, ack sent
       // put byte into buffer
-      twi_masterBuffer[twi_masterBufferIndex++] = TWDR;
+      twi_masterData[twi_masterBufferIndex++] = TWDR;
       __attribute__ ((fallthrough));
     case TW_MR_SLA_ACK:  // address sent, ack received
       // ack if more bytes are expected, otherwise nack
@@ -560,9 +680,10 @@ ISR(TWI_vect)
       break;
     case TW_MR_DATA_NACK: // data received, nack sent
       // put final byte into buffer
-      twi_masterBuffer[twi_masterBufferIndex++] = TWDR;
+      twi_masterData[twi_masterBufferIndex++] = TWDR;
       if (twi_sendStop){
         twi_stop();
+        twi_masterDone();
       } else {
         twi_inRepStart = true;	// we're gonna send the START
         // don't enable the interrupt. We'll generate the start, but we
@@ -573,7 +694,9 @@ ISR(TWI_vect)
       }
       break;
     case TW_MR_SLA_NACK: // address sent, nack received
+      twi_error = TW_MR_SLA_NACK;
       twi_stop();
+      twi_masterDone();
       break;
     // TW_MR_ARB_LOST handled by TW_MT_ARB_LOST case
 
@@ -661,6 +784,7 @@ ISR(TWI_vect)
     case TW_BUS_ERROR: // bus error, illegal stop/start
       twi_error = TW_BUS_ERROR;
       twi_stop();
+      twi_masterDone();
       break;
   }
 }
@@ -46,9 +46,12 @@
   void twi_setFrequency(uint32_t);
   uint8_t twi_readFrom(uint8_t, uint8_t*, uint8_t, uint8_t);
   uint8_t twi_writeTo(uint8_t, uint8_t*, uint8_t, uint8_t, uint8_t);
+  uint8_t twi_writeToAsync(uint8_t, uint8_t*, uint8_t);
+  uint8_t twi_readFromAsync(uint8_t, uint8_t*, uint8_t);
   uint8_t twi_transmit(const uint8_t*, uint8_t);
   void twi_attachSlaveRxEvent( void (*)(uint8_t*, int) );
   void twi_attachSlaveTxEvent( void (*)(void) );
+  void twi_attachMasterDoneEvent( void (*)(uint8_t) );
   void twi_reply(uint8_t);
   void twi_stop(void);
   void twi_releaseBus(void);
@@ -0,0 +1,145 @@
+/*
+	该程序基于简易的arduino硬件，主要目的是烧录SPI Flash，如W25QXX等，主要原理是实现了UART转SPI的功能，需配合上位机使用。
+  也可烧录eepron，如24cxx
+  串口波特率协商
+    Copyright (C) 2023  LiHangBing
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <arduino.h>
+#include "defines.h"
+#include "uart_cmd.h"
+#include "commands.h"
+#include "link.h"
+#include "frame.h"
+
+extern byte buff[buffSize];
+
+static const byte baud_probe[] = {0xa5, 0x5a, 0x55, 0xaa};   //探测码，0x55/0xaa交替位对波特率误差最敏感
+
+unsigned long uart_baud = UART_SPEED;      //当前波特率
+byte pipe_mode = 0;
+
+//检查波特率是否可设置：可设置的波特率为 Fcpu/8/(n+1)，误差需小于2.5%（16MHz下115200误差约2.1%，实测可用）
+static bool baud_valid(unsigned long baud)
+{
+  unsigned long n;
+  unsigned long real;
+
+  if (baud == 0 || baud > F_CPU / 8)
+    return false;
+
+  n = (F_CPU / 4 / baud - 1) / 2;     //与link_begin的计算一致
+  real = F_CPU / 8 / (n + 1);
+  if (real > baud)
+    return (real - baud) * 40 < baud;
+  return (baud - real) * 40 < baud;
+}
+
+//40 波特率协商 ----------------------------------------------
+//参数：新波特率(4字节，高字节在前)
+//流程：回传命令码后双方切换到新波特率，上位机发送探测码，下位机原样回传探测码及命令码，
+//      上位机收到后以新波特率发送确认字节（FUNC_UART_BAUD），下位机收到确认才启用新波特率并回传命令码；
+//      探测码错误、超时或LINK_TIMEOUT内没有收到确认，下位机自动回退到原波特率（上位机收不到回复时同样回退）
+//      上位机收不到最后的命令码时，可在两种波特率下分别发送FUNC_SPI_TST确认下位机的波特率
+void uart_cmd_baud()
+{
+  byte bytesread;
+  unsigned long baud;
+  unsigned long old_baud;
+
+  bytesread = link_read(buff, 4);      //从串口读取4字节，指示新的波特率
+  if (bytesread != 4) {
+    link_write(ERROR_TIMOUT); //超时
+    cmd_flush();
+    return;
+  }
+
+  baud = ((unsigned long)buff[0] << 24) | ((unsigned long)buff[1] << 16) | ((unsigned long)buff[2] << 8) | buff[3];
+  if (!baud_valid(baud)) {
+    link_write(ERROR_RECV); //无法设置的波特率
+    cmd_flush();
+    return;
+  }
+
+  link_write(FUNC_UART_BAUD);    //以原波特率回传cmd，之后切换
+  link_flush();                 //必须等待发送完成再切换
+
+  old_baud = uart_baud;
+  link_end();
+  link_begin(baud);             //切换波特率（end会清空接收缓冲区）
+
+  bytesread = link_read(buff, sizeof(baud_probe));   //等待上位机以新波特率发送探测码
+  if (bytesread != sizeof(baud_probe) || memcmp(buff, baud_probe, sizeof(baud_probe)) != 0) {
+    link_end();
+    link_begin(old_baud);       //探测失败，回退到原波特率
+    return;
+  }
+
+  link_write(baud_probe, sizeof(baud_probe));   //回传探测码
+  link_write(FUNC_UART_BAUD);    //回传cmd给串口
+  cmd_flush();
+
+  bytesread = link_read(buff, 1);       //等待上位机确认收到回传（新波特率双向可用）
+  if (bytesread != 1 || buff[0] != FUNC_UART_BAUD) {
+    link_end();
+    link_begin(old_baud);       //未确认，回退到原波特率
+    return;
+  }
+
+  uart_baud = baud;
+  link_write(FUNC_UART_BAUD);    //已启用新波特率
+  cmd_flush();
+}
+
+//41 帧模式开关 ----------------------------------------------
+//参数：1字节，非0启用帧模式（连续读上传、区间编程下发的数据均带序号和CRC16，格式见frame.h）
+void uart_cmd_frame()
+{
+  byte bytesread;
+
+  bytesread = link_read(buff, 1);
+  if (bytesread != 1) {
+    link_write(ERROR_TIMOUT); //超时
+    cmd_flush();
+    return;
+  }
+
+  frame_mode = buff[0];
+  link_write(FUNC_UART_FRAME);    //回传cmd给串口
+  cmd_flush();
+}
+
+//42 流水线模式开关 ----------------------------------------------
+//参数：1字节，非0启用流水线模式
+//流水线模式下每条命令格式为 命令码(1) 标签(1) 参数...，下位机先回传标签再回传原有的应答，
+//且不再等待每个应答发送完成；上位机可连续发送多条命令（总长度不超过LINK_RX_SIZE），按标签匹配应答
+void uart_cmd_pipe()
+{
+  byte bytesread;
+
+  bytesread = link_read(buff, 1);
+  if (bytesread != 1) {
+    link_write(ERROR_TIMOUT); //超时
+    cmd_flush();
+    return;
+  }
+
+  link_write(FUNC_UART_PIPE);    //回传cmd给串口，之后切换模式
+  link_flush();
+  pipe_mode = buff[0];
+}
@@ -0,0 +1,12 @@
+#ifndef UART_CMD_H
+#define UART_CMD_H
+
+
+extern byte pipe_mode;     //非0时为流水线模式
+
+void uart_cmd_baud();
+void uart_cmd_frame();
+void uart_cmd_pipe();
+
+
+#endif
@@ -0,0 +1,184 @@
+/*
+    arduinoFlashPro上位机工具：差分烧录
+    读取下位机的4K扇区CRC列表，与新镜像比较，只擦除并烧录有变化的扇区
+
+    编译：g++ -std=c++11 -O2 -o flash_diff flash_diff.cpp flashpro.cpp rle.cpp serial_port.cpp
+    用法：flash_diff <串口> <波特率> <镜像文件> [起始地址] [-n] [-f]
+          以上电波特率(9600)连接后通过FUNC_UART_BAUD协商到指定波特率
+          -n 只打印需要烧录的扇区，不实际写入
+          -f 使用帧模式（带CRC16校验，出错只重传对应帧）
+
+    Copyright (C) 2023  LiHangBing
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "flashpro.h"
+
+struct Run
+{
+  uint32_t first;     //起始扇区号（相对镜像起始）
+  uint32_t count;     //连续扇区数
+};
+
+//比较扇区CRC，把相邻的变化扇区合并为连续区间，减少擦除和编程命令的次数
+static std::vector<Run> plan_runs(const std::vector<uint8_t> &image, const std::vector<uint32_t> &dev_crcs)
+{
+  std::vector<Run> runs;
+  uint32_t sectors = image.size() / FLASH_SECTOR_SIZE;
+
+  for (uint32_t i = 0; i < sectors; i++)
+  {
+    uint32_t crc = crc32_calc(0, &image[i * FLASH_SECTOR_SIZE], FLASH_SECTOR_SIZE);
+    if (i < dev_crcs.size() && crc == dev_crcs[i])
+      continue;
+
+    if (!runs.empty() && runs.back().first + runs.back().count == i)
+      runs.back().count++;
+    else {
+      Run r = {i, 1};
+      runs.push_back(r);
+    }
+  }
+  return runs;
+}
+
+//去掉区间末尾全为0xFF的页（擦除后即为0xFF，无需编程）
+static uint32_t trim_blank_tail(const uint8_t *data, uint32_t len)
+{
+  while (len >= FLASH_PAGE_SIZE)
+  {
+    const uint8_t *p = data + len - FLASH_PAGE_SIZE;
+    uint32_t i;
+    for (i = 0; i < FLASH_PAGE_SIZE && p[i] == 0xff; i++)
+      ;
+    if (i != FLASH_PAGE_SIZE)
+      break;
+    len -= FLASH_PAGE_SIZE;
+  }
+  return len;
+}
+
+static bool load_image(const char *path, std::vector<uint8_t> &image)
+{
+  FILE *f = fopen(path, "rb");
+  uint8_t buf[4096];
+  size_t n;
+
+  if (!f)
+    return false;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    image.insert(image.end(), buf, buf + n);
+  fclose(f);
+
+  image.resize((image.size() + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE, 0xff);   //补齐到扇区
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<uint8_t> image;
+  std::vector<uint32_t> dev_crcs;
+  uint32_t base = 0;
+  bool dry_run = false;
+  bool framed = false;
+  SerialPort port;
+  FlashPro dev(port);
+
+  if (argc < 4) {
+    fprintf(stderr, "usage: %s <port> <baud> <image.bin> [base_addr] [-n] [-f]\n", argv[0]);
+    return 2;
+  }
+  for (int i = 4; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-n") == 0)
+      dry_run = true;
+    else if (strcmp(argv[i], "-f") == 0)
+      framed = true;
+    else
+      base = strtoul(argv[i], NULL, 0);
+  }
+  if (base % FLASH_SECTOR_SIZE) {
+    fprintf(stderr, "base address must be 4K aligned\n");
+    return 2;
+  }
+
+  if (!load_image(argv[3], image) || image.empty()) {
+    fprintf(stderr, "cannot read image %s\n", argv[3]);
+    return 1;
+  }
+  if ((uint64_t)base + image.size() > FLASH_ADDR_LIMIT) {
+    fprintf(stderr, "image exceeds the 16MB 3-byte address range\n");
+    return 2;
+  }
+  if (!port.open(argv[1], FLASH_BOOT_BAUD)) {
+    fprintf(stderr, "cannot open %s\n", argv[1]);
+    return 1;
+  }
+  if (!dev.test()) {
+    fprintf(stderr, "device not responding (0x%02x)\n", dev.last_error());
+    return 1;
+  }
+  if (!dev.set_baud(strtoul(argv[2], NULL, 0))) {
+    fprintf(stderr, "cannot switch to %s baud (0x%02x)\n", argv[2], dev.last_error());
+    return 1;
+  }
+  if (!dev.spi_init(2) || (framed && !dev.set_frame_mode(true))) {
+    fprintf(stderr, "device not responding (0x%02x)\n", dev.last_error());
+    return 1;
+  }
+
+  if (!dev.sector_crc(base, image.size(), dev_crcs)) {
+    fprintf(stderr, "sector crc failed (0x%02x)\n", dev.last_error());
+    return 1;
+  }
+
+  std::vector<Run> runs = plan_runs(image, dev_crcs);
+  uint32_t changed = 0;
+  for (size_t i = 0; i < runs.size(); i++)
+    changed += runs[i].count;
+  printf("%u of %u sectors changed, %u runs\n", changed, (unsigned)(image.size() / FLASH_SECTOR_SIZE), (unsigned)runs.size());
+
+  for (size_t i = 0; i < runs.size(); i++)
+  {
+    uint32_t addr = base + runs[i].first * FLASH_SECTOR_SIZE;
+    uint32_t len = runs[i].count * FLASH_SECTOR_SIZE;
+    const uint8_t *data = &image[runs[i].first * FLASH_SECTOR_SIZE];
+    uint32_t crc;
+
+    printf("0x%08x +0x%x\n", addr, len);
+    if (dry_run)
+      continue;
+
+    if (!dev.erase_range(addr, len)) {
+      fprintf(stderr, "erase failed at 0x%08x (0x%02x)\n", addr, dev.last_error());
+      return 1;
+    }
+    if (!dev.program(addr, data, trim_blank_tail(data, len))) {
+      fprintf(stderr, "program failed at 0x%08x (0x%02x)\n", addr, dev.last_error());
+      return 1;
+    }
+    if (!dev.crc32(addr, len, crc) || crc != crc32_calc(0, data, len)) {
+      fprintf(stderr, "verify failed at 0x%08x\n", addr);
+      return 1;
+    }
+  }
+
+  dev.spi_deinit();
+  return 0;
+}
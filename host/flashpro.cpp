@@ -0,0 +1,401 @@
+/*
+    arduinoFlashPro上位机工具：下位机命令封装
+    Copyright (C) 2023  LiHangBing
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "flashpro.h"
+#include "rle.h"
+#include <string.h>
+#include "../arduinoFlashPro/commands.h"     //与固件共用命令码
+
+uint32_t crc32_calc(uint32_t crc, const uint8_t *data, size_t len)
+{
+  crc = ~crc;
+  while (len--)
+  {
+    crc ^= *data++;
+    for (int i = 0; i < 8; i++)
+      crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+uint16_t crc16_calc(uint16_t crc, const uint8_t *data, size_t len)
+{
+  while (len--)
+  {
+    crc ^= (uint16_t)*data++ << 8;
+    for (int i = 0; i < 8; i++)
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+FlashPro::FlashPro(SerialPort &port) : port(port), error(0), frame_mode(false), link_baud(FLASH_BOOT_BAUD)
+{
+}
+
+//等待指定的回传码，收到其他字节或超时返回false
+bool FlashPro::expect(uint8_t code, unsigned timeout_ms)
+{
+  int c = skip_busy(timeout_ms);        //命令需等待后台擦除时，应答前有STATUS_BUSY
+  if (c == code)
+    return true;
+  error = c < 0 ? 0 : c;
+  return false;
+}
+
+//跳过长时间操作期间的进度字节，返回第一个非进度字节，超时返回-1
+int FlashPro::skip_busy(unsigned timeout_ms)
+{
+  int c;
+  do {
+    c = port.read_byte(timeout_ms);
+  } while (c == STATUS_BUSY);
+  return c;
+}
+
+//区间类命令参数：[读操作码 地址长度 空字节数] 地址(3) 长度(4)
+//读(03)、页编程(02)及固件的擦除操作码均为3字节地址，区间超出FLASH_ADDR_LIMIT时返回false
+bool FlashPro::put_range(std::vector<uint8_t> &cmd, uint32_t addr, uint32_t len, bool with_read_opcode)
+{
+  if ((uint64_t)addr + len > FLASH_ADDR_LIMIT) {
+    error = 0;
+    return false;
+  }
+
+  if (with_read_opcode) {
+    cmd.push_back(0x03);
+    cmd.push_back(3);
+    cmd.push_back(0);
+  }
+  else
+    cmd.push_back(3);
+  for (int i = 2; i >= 0; i--)
+    cmd.push_back(addr >> (i * 8));
+  for (int i = 3; i >= 0; i--)
+    cmd.push_back(len >> (i * 8));
+  return true;
+}
+
+bool FlashPro::test()
+{
+  static const uint8_t id[] = {0xa5, 0x5a};
+  uint8_t buf[2];
+
+  if (!port.write_byte(FUNC_SPI_TST))
+    return false;
+  if (port.read(buf, 2, 2000) != 2 || buf[0] != 0xa5 || buf[1] != 0x5a)
+    return false;
+  port.write(id, 2);
+  return expect(FUNC_SPI_TST);
+}
+
+//波特率协商：以当前波特率发送请求，收到回传后切换到新波特率发送探测码，
+//收到探测码回传后发送确认字节，下位机收到确认才启用新波特率，失败时双方都回到原波特率
+bool FlashPro::set_baud(unsigned long baud)
+{
+  static const uint8_t probe[] = {0xa5, 0x5a, 0x55, 0xaa};
+  uint8_t cmd[] = {FUNC_UART_BAUD, (uint8_t)(baud >> 24), (uint8_t)(baud >> 16), (uint8_t)(baud >> 8), (uint8_t)baud};
+  uint8_t buf[sizeof(probe) + 1];
+
+  if (baud == link_baud)
+    return true;
+  if (!port.write(cmd, sizeof(cmd)) || !expect(FUNC_UART_BAUD))
+    return false;
+  if (!port.set_baud(baud)) {
+    error = 0;
+    port.discard(1100);                 //本机不支持该波特率，等下位机收不到探测码后回退
+    return false;
+  }
+
+  if (!port.write(probe, sizeof(probe)) || port.read(buf, sizeof(buf), 2000) != sizeof(buf) ||
+      memcmp(buf, probe, sizeof(probe)) != 0 || buf[sizeof(probe)] != FUNC_UART_BAUD) {
+    error = 0;
+    port.set_baud(link_baud);
+    port.discard(1100);                 //不发送确认，等下位机LINK_TIMEOUT后回退
+    return false;
+  }
+
+  if (port.write_byte(FUNC_UART_BAUD) && expect(FUNC_UART_BAUD)) {
+    link_baud = baud;
+    return true;
+  }
+  if (test()) {                         //只丢了最后的回传，下位机已启用新波特率
+    link_baud = baud;
+    return true;
+  }
+  port.set_baud(link_baud);             //确认未送达，下位机已回退
+  error = 0;
+  return false;
+}
+
+bool FlashPro::spi_init(uint8_t div)
+{
+  uint8_t cmd[] = {FUNC_SPI_INIT, div};
+  return port.write(cmd, sizeof(cmd)) && expect(FUNC_SPI_INIT);
+}
+
+bool FlashPro::spi_deinit()
+{
+  return port.write_byte(FUNC_SPI_DEINIT) && expect(FUNC_SPI_DEINIT);
+}
+
+bool FlashPro::set_frame_mode(bool on)
+{
+  uint8_t cmd[] = {FUNC_UART_FRAME, on};
+  if (!port.write(cmd, sizeof(cmd)) || !expect(FUNC_UART_FRAME))
+    return false;
+  frame_mode = on;
+  return true;
+}
+
+//帧模式连续读：序号和长度正确但CRC错误的帧记录下来，读完后按偏移只重读对应的区间；
+//序号或长度不对、超时说明丢失或多出了字节，之后的帧都已错位，清空输入后把剩余区间作为一次连续读重新请求
+bool FlashPro::read_frames(uint32_t addr, uint32_t len, std::vector<uint8_t> &data)
+{
+  std::vector<uint32_t> bad;
+  uint8_t buf[FLASH_CHUNK_SIZE + 4];
+  uint32_t start = 0;                   //当前连续读的起始偏移，帧序号从此处开始计
+  uint32_t off;
+  int resync = 0;
+
+  data.assign(len, 0xff);
+  while (1)
+  {
+    for (off = start; off < len; off += FLASH_CHUNK_SIZE)
+    {
+      uint32_t n = len - off < FLASH_CHUNK_SIZE ? len - off : FLASH_CHUNK_SIZE;
+      if (port.read(buf, 2, 2000) != 2 || buf[0] != (uint8_t)((off - start) / FLASH_CHUNK_SIZE) || buf[1] != (uint8_t)n ||
+          port.read(buf + 2, n + 2, 2000) != n + 2)
+        break;                          //错位或超时
+      if (crc16_calc(0, buf, n + 2) != (((uint16_t)buf[n + 2] << 8) | buf[n + 3])) {
+        bad.push_back(off);
+        continue;
+      }
+      memcpy(&data[off], buf + 2, n);
+    }
+
+    if (off >= len) {
+      if (!expect(FUNC_SPI_READ_BULK))
+        port.discard(50);               //数据已收齐，只是尾部状态出错
+      break;
+    }
+
+    port.discard(50);                   //等下位机发完本次连续读
+    if (++resync > FRAME_RETRY)
+      return false;
+    std::vector<uint8_t> cmd(1, FUNC_SPI_READ_BULK);
+    if (!put_range(cmd, addr + off, len - off, true))
+      return false;
+    if (!port.write(cmd.data(), cmd.size()) || !expect(FUNC_SPI_READ_BULK))
+      return false;
+    start = off;
+  }
+
+  for (size_t k = 0; k < bad.size(); k++)
+  {
+    off = bad[k];
+    uint32_t n = len - off < FLASH_CHUNK_SIZE ? len - off : FLASH_CHUNK_SIZE;
+    int retry;
+
+    for (retry = 0; retry < FRAME_RETRY; retry++)
+    {
+      std::vector<uint8_t> cmd(1, FUNC_SPI_READ_BULK);
+      if (!put_range(cmd, addr + off, n, true))
+        return false;
+      if (port.write(cmd.data(), cmd.size()) && expect(FUNC_SPI_READ_BULK) &&
+          port.read(buf, n + 4, 2000) == n + 4 && buf[0] == 0 && buf[1] == (uint8_t)n &&
+          crc16_calc(0, buf, n + 2) == (((uint16_t)buf[n + 2] << 8) | buf[n + 3]) &&
+          expect(FUNC_SPI_READ_BULK))
+        break;
+      port.discard(50);
+    }
+    if (retry == FRAME_RETRY)
+      return false;
+    memcpy(&data[off], buf + 2, n);
+  }
+  return true;
+}
+
+//帧模式下发一段数据，收到NAK或超时时重发，直到收到ack
+bool FlashPro::send_frame(uint8_t seq, const uint8_t *data, uint32_t len, uint8_t ack)
+{
+  std::vector<uint8_t> frame;
+  uint16_t crc;
+
+  frame.push_back(seq);
+  frame.push_back((uint8_t)len);        //256时为0
+  frame.insert(frame.end(), data, data + len);
+  crc = crc16_calc(0, frame.data(), frame.size());
+  frame.push_back(crc >> 8);
+  frame.push_back(crc);
+
+  for (int retry = 0; retry < FRAME_RETRY; retry++)
+  {
+    if (!port.write(frame.data(), frame.size()))
+      return false;
+    int c = port.read_byte(2000);
+    if (c == ack)
+      return true;
+    if (c == STATUS_NAK) {
+      port.read_byte(2000);             //期望的序号
+      continue;
+    }
+    if (c >= 0) {
+      error = c;
+      return false;                     //其他错误，下位机已退出
+    }
+  }
+  error = 0;
+  return false;
+}
+
+//连续读，compressed为true时下位机以压缩流上传
+bool FlashPro::read_bulk(uint32_t addr, uint32_t len, std::vector<uint8_t> &data, bool compressed)
+{
+  std::vector<uint8_t> cmd(1, FUNC_SPI_READ_BULK);
+  uint8_t buf[256];
+  size_t n;
+
+  if (!put_range(cmd, addr, len, true))
+    return false;
+  if (compressed && !frame_mode)
+    cmd[3] |= 0x80;                     //空字节数的最高位：压缩流
+  if (!port.write(cmd.data(), cmd.size()) || !expect(FUNC_SPI_READ_BULK))
+    return false;
+
+  if (frame_mode)
+    return read_frames(addr, len, data);
+
+  data.clear();
+  data.reserve(len);
+  if (!compressed) {
+    while (data.size() < len)
+    {
+      n = len - data.size() < sizeof(buf) ? len - data.size() : sizeof(buf);
+      n = port.read(buf, n, 2000);
+      if (n == 0) {
+        error = 0;
+        return false;
+      }
+      data.insert(data.end(), buf, buf + n);
+    }
+  }
+  else {
+    RleDecoder dec;
+    while (data.size() < len)
+    {
+      int c = port.read_byte(2000);
+      if (c < 0 || !dec.feed(c, data)) {
+        error = 0;
+        return false;
+      }
+    }
+  }
+  return data.size() == len && expect(FUNC_SPI_READ_BULK);
+}
+
+bool FlashPro::sector_crc(uint32_t addr, uint32_t len, std::vector<uint32_t> &crcs)
+{
+  std::vector<uint8_t> cmd(1, FUNC_SPI_SECTOR_CRC);
+  uint8_t buf[4];
+
+  if (!put_range(cmd, addr, len, true))
+    return false;
+  if (!port.write(cmd.data(), cmd.size()) || !expect(FUNC_SPI_SECTOR_CRC))
+    return false;
+
+  crcs.clear();
+  for (uint32_t i = 0; i < len / FLASH_SECTOR_SIZE; i++)
+  {
+    if (port.read(buf, 4, 2000) != 4) {
+      error = 0;
+      return false;
+    }
+    crcs.push_back(((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3]);
+  }
+  return expect(FUNC_SPI_SECTOR_CRC);
+}
+
+bool FlashPro::erase_range(uint32_t addr, uint32_t len)
+{
+  std::vector<uint8_t> cmd(1, FUNC_SPI_ERASE);
+  int c;
+
+  cmd.push_back(4);                     //区间擦除
+  if (!put_range(cmd, addr, len, false))
+    return false;
+  if (!port.write(cmd.data(), cmd.size()) || !expect(FUNC_SPI_ERASE))
+    return false;
+
+  while ((c = skip_busy(2000)) >= 0 && c <= 3)    //每完成一个擦除单元回传其类型
+    ;
+  if (c == FUNC_SPI_ERASE)
+    return true;
+  error = c < 0 ? 0 : c;
+  return false;
+}
+
+bool FlashPro::program(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+  std::vector<uint8_t> cmd(1, FUNC_SPI_PROGRAM);
+  uint32_t n;
+  uint8_t seq = 0;
+
+  cmd.push_back(0x02);                  //页编程
+  if (!put_range(cmd, addr, len, false))
+    return false;
+  if (!port.write(cmd.data(), cmd.size()) || !expect(FUNC_SPI_PROGRAM))
+    return false;
+
+  while (len > 0)
+  {
+    n = FLASH_PAGE_SIZE - addr % FLASH_PAGE_SIZE;     //与固件相同的按页拆分
+    if (n > len)
+      n = len;
+    if (frame_mode) {
+      if (!send_frame(seq++, data, n, FUNC_SPI_PROGRAM))
+        return false;
+    }
+    else if (!port.write(data, n) || !expect(FUNC_SPI_PROGRAM))
+      return false;
+    addr += n;
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool FlashPro::crc32(uint32_t addr, uint32_t len, uint32_t &crc)
+{
+  std::vector<uint8_t> cmd(1, FUNC_SPI_CRC32);
+  uint8_t buf[4];
+  int c;
+
+  if (!put_range(cmd, addr, len, true))
+    return false;
+  if (!port.write(cmd.data(), cmd.size()) || !expect(FUNC_SPI_CRC32))
+    return false;
+
+  c = skip_busy(2000);
+  if (c != FUNC_SPI_CRC32 || port.read(buf, 4, 2000) != 4) {
+    error = c < 0 ? 0 : c;
+    return false;
+  }
+  crc = ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+  return expect(FUNC_SPI_CRC32);
+}
@@ -0,0 +1,51 @@
+#ifndef FLASHPRO_H
+#define FLASHPRO_H
+
+#include <stdint.h>
+#include <vector>
+#include "serial_port.h"
+
+#define FLASH_SECTOR_SIZE 4096
+#define FLASH_PAGE_SIZE   256
+#define FLASH_CHUNK_SIZE  128       //与固件buffSize一致，帧模式下连续读每帧的长度
+#define FRAME_RETRY       8
+#define FLASH_ADDR_LIMIT  0x1000000 //只使用3字节地址的操作码(03/02/20...)，不支持16MB以上的区间
+#define FLASH_BOOT_BAUD   9600      //下位机上电波特率，与固件UART_SPEED一致
+
+uint32_t crc32_calc(uint32_t crc, const uint8_t *data, size_t len);   //与固件一致的CRC32，crc首次传0
+uint16_t crc16_calc(uint16_t crc, const uint8_t *data, size_t len);   //CRC16-CCITT(XMODEM)，帧校验
+
+//arduinoFlashPro下位机命令封装，各函数成功返回true
+class FlashPro
+{
+  public:
+    explicit FlashPro(SerialPort &port);
+
+    bool test();
+    bool set_baud(unsigned long baud);
+    bool spi_init(uint8_t div);
+    bool spi_deinit();
+    bool set_frame_mode(bool on);
+    bool read_bulk(uint32_t addr, uint32_t len, std::vector<uint8_t> &data, bool compressed);
+    bool sector_crc(uint32_t addr, uint32_t len, std::vector<uint32_t> &crcs);
+    bool erase_range(uint32_t addr, uint32_t len);
+    bool program(uint32_t addr, const uint8_t *data, uint32_t len);
+    bool crc32(uint32_t addr, uint32_t len, uint32_t &crc);
+
+    uint8_t last_error() const { return error; }      //最后一次失败时收到的字节（超时为0）
+
+  private:
+    bool expect(uint8_t code, unsigned timeout_ms = 2000);
+    int skip_busy(unsigned timeout_ms);
+    bool put_range(std::vector<uint8_t> &cmd, uint32_t addr, uint32_t len, bool with_read_opcode);
+    bool read_frames(uint32_t addr, uint32_t len, std::vector<uint8_t> &data);
+    bool send_frame(uint8_t seq, const uint8_t *data, uint32_t len, uint8_t ack);
+
+    SerialPort &port;
+    uint8_t error;
+    bool frame_mode;
+    unsigned long link_baud;       //当前与下位机通信的波特率
+};
+
+
+#endif
@@ -0,0 +1,87 @@
+/*
+    arduinoFlashPro上位机工具：连续读压缩流解码
+    Copyright (C) 2023  LiHangBing
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "rle.h"
+
+enum
+{
+  ST_OP,          //等待控制字节
+  ST_LIT,         //原样字节
+  ST_LEN_HI,      //长重复的长度
+  ST_LEN_LO,
+  ST_VAL          //重复的字节
+};
+
+RleDecoder::RleDecoder()
+{
+  reset();
+}
+
+void RleDecoder::reset()
+{
+  state = ST_OP;
+  count = 0;
+}
+
+bool RleDecoder::feed(uint8_t c, std::vector<uint8_t> &out)
+{
+  switch (state)
+  {
+    case ST_OP:
+      if (c < 0x80) {
+        count = c + 1;
+        state = ST_LIT;
+      }
+      else if (c < 0xfe) {
+        count = c - 0x80 + 3;
+        state = ST_VAL;
+      }
+      else if (c == 0xfe) {
+        if (out.size() < RLE_BLOCK)
+          return false;
+        size_t from = out.size() - RLE_BLOCK;
+        for (size_t i = 0; i < RLE_BLOCK; i++)
+          out.push_back(out[from + i]);
+      }
+      else
+        state = ST_LEN_HI;
+      break;
+
+    case ST_LIT:
+      out.push_back(c);
+      if (--count == 0)
+        state = ST_OP;
+      break;
+
+    case ST_LEN_HI:
+      count = (uint32_t)c << 8;
+      state = ST_LEN_LO;
+      break;
+
+    case ST_LEN_LO:
+      count = (count | c) + 1;
+      state = ST_VAL;
+      break;
+
+    case ST_VAL:
+      out.insert(out.end(), count, c);
+      state = ST_OP;
+      break;
+  }
+  return true;
+}
@@ -0,0 +1,25 @@
+#ifndef RLE_H
+#define RLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+//连续读压缩流解码，格式与固件arduinoFlashPro/rle.h一致
+#define RLE_BLOCK 64
+
+class RleDecoder
+{
+  public:
+    RleDecoder();
+
+    void reset();
+    bool feed(uint8_t c, std::vector<uint8_t> &out);    //逐字节解码，格式错误返回false
+
+  private:
+    uint8_t state;
+    uint32_t count;
+};
+
+
+#endif
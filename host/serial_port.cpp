@@ -0,0 +1,156 @@
+/*
+    arduinoFlashPro上位机工具：POSIX串口封装
+    Copyright (C) 2023  LiHangBing
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "serial_port.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+SerialPort::SerialPort() : fd(-1)
+{
+}
+
+SerialPort::~SerialPort()
+{
+  close();
+}
+
+//波特率转换为termios常量，不支持时返回0
+static speed_t baud_to_speed(unsigned long baud)
+{
+  switch (baud)
+  {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+#ifdef B500000
+    case 500000: return B500000;
+#endif
+#ifdef B1000000
+    case 1000000: return B1000000;
+#endif
+#ifdef B2000000
+    case 2000000: return B2000000;
+#endif
+    default: return 0;
+  }
+}
+
+bool SerialPort::open(const char *path, unsigned long baud)
+{
+  close();
+  fd = ::open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0)
+    return false;
+
+  if (!set_baud(baud)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void SerialPort::close()
+{
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+bool SerialPort::set_baud(unsigned long baud)
+{
+  struct termios tio;
+  speed_t speed = baud_to_speed(baud);
+
+  if (fd < 0 || speed == 0 || tcgetattr(fd, &tio) != 0)
+    return false;
+
+  cfmakeraw(&tio);                    //8N1，无流控
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~CRTSCTS;
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  if (tcsetattr(fd, TCSANOW, &tio) != 0)
+    return false;
+
+  tcflush(fd, TCIOFLUSH);
+  return true;
+}
+
+bool SerialPort::write(const uint8_t *data, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = ::write(fd, data, len);
+    if (n <= 0)
+      return false;
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool SerialPort::write_byte(uint8_t data)
+{
+  return write(&data, 1);
+}
+
+size_t SerialPort::read(uint8_t *data, size_t len, unsigned timeout_ms)
+{
+  size_t got = 0;
+  struct pollfd pfd;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  while (got < len)
+  {
+    if (poll(&pfd, 1, timeout_ms) <= 0)     //超时时间为字节间最大间隔
+      break;
+    ssize_t n = ::read(fd, data + got, len - got);
+    if (n <= 0)
+      break;
+    got += n;
+  }
+  return got;
+}
+
+int SerialPort::read_byte(unsigned timeout_ms)
+{
+  uint8_t data;
+  return read(&data, 1, timeout_ms) == 1 ? data : -1;
+}
+
+void SerialPort::drain()
+{
+  tcdrain(fd);
+}
+
+void SerialPort::discard(unsigned idle_ms)
+{
+  uint8_t buf[256];
+  while (read(buf, sizeof(buf), idle_ms) > 0)
+    ;
+}
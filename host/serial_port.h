@@ -0,0 +1,30 @@
+#ifndef SERIAL_PORT_H
+#define SERIAL_PORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+//POSIX串口封装（Linux/macOS），供上位机工具使用
+class SerialPort
+{
+  public:
+    SerialPort();
+    ~SerialPort();
+
+    bool open(const char *path, unsigned long baud);
+    void close();
+    bool set_baud(unsigned long baud);
+
+    bool write(const uint8_t *data, size_t len);
+    bool write_byte(uint8_t data);
+    size_t read(uint8_t *data, size_t len, unsigned timeout_ms);   //读满len字节或超时，返回实际读取的字节数
+    int read_byte(unsigned timeout_ms);                             //超时返回-1
+    void drain();                                                   //等待发送完成
+    void discard(unsigned idle_ms);                                 //丢弃输入，直到线路空闲idle_ms
+
+  private:
+    int fd;
+};
+
+
+#endif